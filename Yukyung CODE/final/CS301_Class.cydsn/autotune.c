@@ -0,0 +1,114 @@
+#include <stdint.h>
+
+#include "autotune.h"
+#include "steer.h"       // STEER_GAIN_MAX_Q8
+
+/* ===================== State ===================== */
+static int16_t  s_h = 0;
+static int32_t  s_eps = 0;
+static uint16_t s_dt_ms = 8;
+
+static int8_t   s_relay = 1;         /* +1 / -1 */
+static uint32_t s_t_ms = 0;
+static uint32_t s_up_ms = 0;         /* time of the last switch to +h */
+static uint8_t  s_have_up = 0;
+static int32_t  s_e_max = 0, s_e_min = 0;
+static uint8_t  s_cycles = 0;        /* complete cycles seen */
+static uint32_t s_sum_period = 0;
+static uint32_t s_sum_amp = 0;
+static autotune_result_t s_res;
+
+static uint32_t isqrt32(uint32_t x)
+{
+    uint32_t r = 0, b = 1uL << 30;
+    while (b > x) b >>= 2;
+    while (b) {
+        if (x >= r + b) { x -= r + b; r = (r >> 1) + b; }
+        else            { r >>= 1; }
+        b >>= 2;
+    }
+    return r;
+}
+
+void Autotune_Start(int16_t h, int32_t eps_q15, uint16_t dt_ms)
+{
+    s_h = h;
+    s_eps = eps_q15;
+    s_dt_ms = dt_ms;
+    s_relay = 1;
+    s_t_ms = 0;
+    s_have_up = 0u;
+    s_e_max = s_e_min = 0;
+    s_cycles = 0u;
+    s_sum_period = 0u;
+    s_sum_amp = 0u;
+}
+
+/* Ku, Tu and the PI gains from the averaged cycles */
+static uint8_t finish(void)
+{
+    uint32_t n   = AUTOTUNE_CYCLES;
+    uint32_t amp = s_sum_amp / n;
+    uint32_t tu  = s_sum_period / n;
+    if (amp <= (uint32_t)s_eps || tu == 0u) return AUTOTUNE_FAILED;
+
+    /* amplitude the relay actually saw past its hysteresis */
+    uint32_t a = isqrt32(amp * amp - (uint32_t)s_eps * (uint32_t)s_eps);
+    if (a == 0u) return AUTOTUNE_FAILED;
+
+    /* 4 / pi = 326 / 256 */
+    int32_t ku_q8 = (int32_t)(((uint32_t)s_h * 326u * 32768u) / a);
+
+    s_res.ku_q8   = ku_q8;
+    s_res.tu_ms   = (uint16_t)((tu > 0xFFFFu) ? 0xFFFFu : tu);
+    s_res.amp_q15 = (uint16_t)((amp > 0xFFFFu) ? 0xFFFFu : amp);
+    s_res.kp_q8   = (int32_t)(((int64_t)ku_q8 * 45) / 100);
+    s_res.ki_q8   = (int32_t)(((int64_t)ku_q8 * 540) / (int32_t)tu);
+
+    /* a tiny amplitude or period gives gains no straight can use */
+    if (s_res.kp_q8 <= 0 || s_res.kp_q8 > STEER_GAIN_MAX_Q8 ||
+        s_res.ki_q8 < 0  || s_res.ki_q8 > STEER_GAIN_MAX_Q8) return AUTOTUNE_FAILED;
+    return AUTOTUNE_DONE;
+}
+
+uint8_t Autotune_Step(uint8_t valid, int32_t e_q15, int* steer)
+{
+    s_t_ms += s_dt_ms;
+    if (!valid || s_t_ms > AUTOTUNE_MAX_MS) {
+        *steer = 0;
+        return AUTOTUNE_FAILED;
+    }
+
+    if (e_q15 > s_e_max) s_e_max = e_q15;
+    if (e_q15 < s_e_min) s_e_min = e_q15;
+
+    if (s_relay < 0 && e_q15 > s_eps) {
+        /* switch to +h: one full cycle since the previous one */
+        s_relay = 1;
+        if (s_have_up) {
+            s_cycles++;
+            if (s_cycles > AUTOTUNE_SKIP) {
+                s_sum_period += s_t_ms - s_up_ms;
+                s_sum_amp    += (uint32_t)(s_e_max - s_e_min) / 2u;
+            }
+        }
+        s_up_ms = s_t_ms;
+        s_have_up = 1u;
+        s_e_max = s_e_min = e_q15;
+
+        if (s_cycles >= AUTOTUNE_SKIP + AUTOTUNE_CYCLES) {
+            *steer = 0;
+            return finish();
+        }
+    } else if (s_relay > 0 && e_q15 < -s_eps) {
+        s_relay = -1;
+    }
+
+    *steer = s_relay * s_h;
+    return AUTOTUNE_RUNNING;
+}
+
+void Autotune_Result(autotune_result_t* r)
+{
+    *r = s_res;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <stdint.h>
+
+/* Relay-feedback (Astrom-Hagglund) autotune of the steering PI. While the
+ * robot drives a straight, the steer output is a relay of +/- h on the sign
+ * of the line error (with hysteresis eps). The loop settles into a limit
+ * cycle whose amplitude a and period Tu give the ultimate gain
+ *     Ku = 4 h / (pi * sqrt(a^2 - eps^2))
+ * and Ziegler-Nichols PI:  Kp = 0.45 Ku,  Ki = Kp / (Tu / 1.2) = 0.54 Ku / Tu.
+ * Units match steer_t: error in Q15, steer %, gains in Q8. Gains outside
+ * 0 .. STEER_GAIN_MAX_Q8 fail the run. */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AUTOTUNE_SKIP          2u      /* cycles to let the oscillation settle */
+#define AUTOTUNE_CYCLES        4u      /* cycles averaged */
+#define AUTOTUNE_MAX_MS     8000u      /* give up if no limit cycle by then */
+
+#define AUTOTUNE_RUNNING       0u
+#define AUTOTUNE_DONE          1u
+#define AUTOTUNE_FAILED        2u
+
+typedef struct {
+    int32_t  kp_q8;            /* Ziegler-Nichols PI */
+    int32_t  ki_q8;
+    int32_t  ku_q8;            /* ultimate gain, steer % per unit error */
+    uint16_t tu_ms;            /* ultimate period */
+    uint16_t amp_q15;          /* mean error amplitude */
+} autotune_result_t;
+
+/* h = relay output (steer %), eps_q15 = hysteresis, dt_ms = call period */
+void Autotune_Start(int16_t h, int32_t eps_q15, uint16_t dt_ms);
+
+/* One loop: error in, steer % out; returns AUTOTUNE_* */
+uint8_t Autotune_Step(uint8_t valid, int32_t e_q15, int* steer);
+
+/* Result of a run that returned AUTOTUNE_DONE */
+void Autotune_Result(autotune_result_t* r);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,54 @@
+#include <project.h>
+#include <stdint.h>
+
+#include "calib.h"
+#include <sensors.h>     // Sensor_ComputePeakToPeak(), Sensor_SetCalibration()
+#include "directions.h"  // Directions_Pivot()
+
+/* ===================== Tunables ===================== */
+#define CAL_SWING_MS          250   /* one pivot leg, enough to carry S3..S6 across the tape */
+#define CAL_STEP_MS            25   /* >= one sensor window, so every read is a new value */
+#define CAL_SETTLE_MS         150   /* stand still between legs */
+
+/* Left, right past the start heading, then back to it */
+static const uint8_t CAL_LEGS[] = { 1u, 2u, 2u, 1u };
+
+static calib_log_t s_log;
+
+uint8_t Calib_Run(void)
+{
+    uint16_t on_pp[SENSOR_NUM_CH], off_pp[SENSOR_NUM_CH];
+    for (uint8_t ch = 0; ch < SENSOR_NUM_CH; ch++) {
+        on_pp[ch]  = 0xFFFFu;
+        off_pp[ch] = 0u;
+    }
+
+    CyDelay(CAL_SETTLE_MS);
+    for (uint8_t leg = 0; leg < sizeof(CAL_LEGS); leg++) {
+        Directions_Pivot(CAL_LEGS[leg]);
+        for (uint16_t t = 0; t < CAL_SWING_MS; t += CAL_STEP_MS) {
+            CyDelay(CAL_STEP_MS);
+            for (uint8_t ch = 0; ch < SENSOR_NUM_CH; ch++) {
+                uint16_t pp = Sensor_ComputePeakToPeak(ch);
+                if (pp < on_pp[ch])  on_pp[ch]  = pp;
+                if (pp > off_pp[ch]) off_pp[ch] = pp;
+            }
+        }
+        Directions_Pivot(0u);
+        CyDelay(CAL_SETTLE_MS);
+    }
+
+    uint8_t mask = 0;
+    for (uint8_t ch = 0; ch < SENSOR_NUM_CH; ch++) {
+        if (Sensor_SetCalibration(ch, on_pp[ch], off_pp[ch])) mask |= (uint8_t)(1u << ch);
+        s_log.on_pp[ch]  = on_pp[ch];
+        s_log.off_pp[ch] = off_pp[ch];
+    }
+    s_log.mask = mask;
+    return mask;
+}
+
+const calib_log_t* Calib_Log(void)
+{
+    return &s_log;
+}
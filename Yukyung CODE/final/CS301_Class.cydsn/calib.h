@@ -0,0 +1,33 @@
+#pragma once
+#include <stdint.h>
+#include <sensors.h>     // SENSOR_NUM_CH
+
+/* Startup calibration sweep for the six line sensors.
+ * Place the robot on a straight line; Calib_Run() rocks it left and right with
+ * the Directions pivot helpers, records the lowest (over the line) and highest
+ * (over the floor) peak-to-peak level of every channel and hands them to
+ * Sensor_SetCalibration(). A channel that never saw both, or whose levels do
+ * not look like tape against floor, keeps the default band.
+ * Returns a bit mask of the calibrated (trusted) channels (bit 0 = S1).
+ */
+
+/* Every channel trusted */
+#define CALIB_MASK_ALL   ((uint8_t)((1u << SENSOR_NUM_CH) - 1u))
+
+/* What the last Calib_Run() saw, for the 'K' USB block */
+typedef struct {
+    uint8_t  mask;                      /* Calib_Run() result */
+    uint16_t on_pp[SENSOR_NUM_CH];      /* lowest p-p seen (over the line) */
+    uint16_t off_pp[SENSOR_NUM_CH];     /* highest p-p seen (over the floor) */
+} calib_log_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint8_t Calib_Run(void);
+const calib_log_t* Calib_Log(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -4,12 +4,28 @@
 
 #include "directions.h"
 #include "motor_s.h"     // set_motors_symmetric(), set_motors_with_trim_and_steer(), motor_enable
+#include "wheel.h"       // Wheel_Drive(), Wheel_AbsTicks() for arc turns
+#include "sensors.h"     // Sensor_LineState() ends an arc
 #include "defines.h"     // your project-wide defines
 
 /* ===================== Tunables ===================== */
-/* Encoder counts for ~90° pivots (tune on your tape) */
+/* Encoder counts for ~90° pivots (tune on your tape). These are the starting
+ * points of the learned targets below. */
 static volatile int32_t TICKS_90_LEFT  = 90;   /* abs(|ΔL|)+abs(|ΔR|) */
 static volatile int32_t TICKS_90_RIGHT = 90;
+static volatile int32_t TICKS_180_U    = 180;  /* U-turn, same units */
+
+/* Learned targets: after each turn main reports the line angle it sees
+ * (Directions_Learn()) and the target of that turn kind moves by
+ * LEARN_PCT of the error, at most LEARN_STEP_MAX counts, and stays within
+ * +-50 % of the hand-set value. Arcs are kept per entry speed
+ * (below / above ARC_V_SPLIT_MM_S). */
+#define LEARN_PCT              50
+#define LEARN_STEP_MAX          6
+#define LEARN_DEADBAND_MRAD    20     /* ~1 degree */
+#define LEARN_MAX_MRAD        400     /* more than this is a misread, not a turn error */
+#define ARC_V_SPLIT_MM_S      250
+#define LEARN_NONE           0xFFu
 
 /* Pivot speed (%) — keep modest to avoid overshoot */
 // Side-specific pivot speeds (percent duty)
@@ -18,6 +34,64 @@ static volatile int32_t TICKS_90_RIGHT = 90;
 #define PIVOT_SPEED_U         42   // U turn speed
 #define STOP_BEFORE_MS        110
 #define BRAKE_AFTER_MS        500
+#define KICK_MS                60
+
+/* Stop and brake end early once the wheels are still: no more than
+ * STILL_COUNTS encoder counts (both wheels) per call for STILL_MS,
+ * but never before SETTLE_MIN_MS. */
+#define SETTLE_MIN_MS          40
+#define STILL_MS               24
+#define STILL_COUNTS            1
+
+/* Arc turns. Heading is measured in pivot units (TICKS_90_* per 90 degrees,
+ * = (right - left) counts): with both wheels rolling forward on radius R the
+ * wheels cover |dL| + |dR| = 2 R theta and a pivot 2 b theta, so the turn so
+ * far is the Wheel_AbsTicks() count since the start times b / R. Past ARC_EXIT_PCT of that the arc ends on the
+ * first S4..S6 hit; ARC_OVER_PCT and ARC_MAX_MS end it regardless. */
+#define ARC_V_MIN_MM_S        100
+#define ARC_V_MAX_MM_S        300     /* outer wheel runs ~2x this */
+#define ARC_EXIT_PCT           60
+#define ARC_OVER_PCT          110
+#define ARC_MAX_MS           1500
+#define ARC_EXIT_MASK        0x38u    /* S4..S6 */
+
+/* Pivot termination
+ *  0 : encoder target only (minus the learned coast)
+ *  1 : the encoder target is a window (PIVOT_WIN_LO..HI_PCT of it); inside
+ *      it the lead sensor (S4 turning left, S6 turning right) reaching the
+ *      new line arms the stop, and the motors are cut PIVOT_PITCH_TICKS
+ *      later minus the coast, so the line ends up under S5. S5 itself stops
+ *      at once if the lead hit was missed; past the window the target does.
+ * The coast (counts after the cut) is measured in every brake window and
+ * averaged per turn kind. */
+#define PIVOT_SENSOR_STOP       1
+#define PIVOT_WIN_LO_PCT       70
+#define PIVOT_WIN_HI_PCT      130
+#define PIVOT_PITCH_TICKS      14     /* S4 -> S5 angle, ~15 mm at ~60 mm from the axle */
+#define PIVOT_COAST_MAX        30
+
+/* Pivot drive
+ *  0 : fixed PIVOT_SPEED_* duty from the first call to the last
+ *  1 : trapezoidal rate profile in counts/s of |dL|+|dR|: ramp up at
+ *      PIVOT_ACC, cruise at PIVOT_W_MAX(_U), ramp down at PIVOT_DEC onto the
+ *      expected stop point (target, or the lead sensor hit + pitch, minus the
+ *      coast), never below PIVOT_W_MIN. The duty is feed-forward from the
+ *      rate plus PI on the rate the encoders report. */
+#define PIVOT_PROFILE           1
+#define PIVOT_W_MAX           640     /* ~30 % duty, the fixed pivot ran 20 % */
+#define PIVOT_W_MAX_U         900     /* ~42 % */
+#define PIVOT_W_MIN           150     /* creep into the sensor window */
+#define PIVOT_ACC            8000     /* counts/s^2, full rate in ~80 ms */
+#define PIVOT_DEC            5000
+#define PIVOT_W_PER_PCT        21     /* counts/s per % duty: 1000 mm/s at 100 %, 0.94 mm/count, two wheels */
+#define PIVOT_DUTY_STATIC       6     /* % on top to break static friction */
+#define PIVOT_KP_Q8             5     /* % per count/s (0.02) */
+#define PIVOT_KI_Q8            64     /* % per count of lag (0.25) */
+#define PIVOT_I_LIM            15     /* % */
+#define PIVOT_DUTY_MAX         60
+
+#define CYC_PER_MS     (BCLK__BUS_CLK__HZ / 1000u)
+#define CYC_PER_US     (BCLK__BUS_CLK__HZ / 1000000u)
 
 /* Safety: max number of handler calls allowed while turning.
  * With your ~8 ms loop this is ~3.2 s (400 * 8 ms) which is plenty. */
@@ -27,9 +101,11 @@ static volatile int32_t TICKS_90_RIGHT = 90;
 /* ===================== Internal state ===================== */
 typedef enum {
     DIR_IDLE = 0,
-    DIR_PREP,
+    DIR_SETTLE,      /* motors off, waiting for the robot to stop */
     DIR_TURNING,
-    DIR_FINISH
+    DIR_BRAKE,       /* motors off after the pivot */
+    DIR_KICK,        /* short forward pulse, then release */
+    DIR_ARC          /* arc at speed, encoders stay with the background task */
 } dir_state_t;
 
 static dir_state_t s_state = DIR_IDLE;
@@ -37,6 +113,30 @@ static uint8_t     s_turn_side = 0;        /* 1 = left, 2 = right */
 static int32_t     s_target_ticks = 0;     /* goal = ~90° */
 static int32_t     s_acc_ticks    = 0;     /* running sum of |ΔL|+|ΔR| */
 static uint16_t    s_safety_count = 0;
+static uint32_t    s_t0 = 0;               /* DWT->CYCCNT at the start of the state */
+static uint32_t    s_moved_at = 0;         /* DWT->CYCCNT when the wheels last moved */
+static uint16_t    s_wait_ms = 0;          /* upper bound of the current timed state */
+static int32_t     s_arc_vl = 0, s_arc_vr = 0;   /* wheel speeds of the arc, mm/s */
+static uint32_t    s_arc_abs0 = 0;         /* Wheel_AbsTicks() at the start */
+static int32_t     s_lead_at = -1;         /* s_acc_ticks at the lead sensor hit, -1 = none */
+static int32_t     s_cut_at = -1;          /* s_acc_ticks at the motor cut, -1 = bail-out */
+static int32_t     s_coast[3] = { 0, 0, 0 };   /* learned coast per s_turn_side - 1 */
+static uint32_t    s_prof_cyc = 0;         /* DWT->CYCCNT at the last profile step */
+static int32_t     s_w_ref = 0;            /* profile rate, counts/s */
+static int32_t     s_w_f = 0;              /* measured rate, filtered */
+static int32_t     s_w_i_q8 = 0;           /* rate integrator, duty % * 256 */
+
+static uint8_t     s_learned[DIR_LEARN_N]; /* targets, see DIR_LEARN_N */
+static uint8_t     s_kind = LEARN_NONE;    /* s_learned index of the running turn */
+static uint8_t     s_last_kind = LEARN_NONE;   /* ... of the last finished one */
+static uint16_t    s_learn_count = 0;
+
+/* Hand-set value of a learned target */
+static int32_t learn_base(uint8_t k)
+{
+    if (k == DIR_LEARN_U) return TICKS_180_U;
+    return (k & 1u) ? TICKS_90_RIGHT : TICKS_90_LEFT;   /* even = left */
+}
 
 /* ---------------- Encoder helpers ----------------
  * We pause your background 5 ms encoder task while we own the counters,
@@ -71,8 +171,8 @@ static inline void enc_reset_local(void)
     s_acc_ticks = 0;
 }
 
-/* Accumulate |ΔL| + |ΔR| since last call, then zero counters */
-static inline void enc_accumulate_now(void)
+/* Accumulate |ΔL| + |ΔR| since last call, then zero counters; returns the step */
+static inline int32_t enc_accumulate_now(void)
 {
     int32_t dL = 0, dR = 0;
 #if defined(QuadDec_M1_GetCounter) && defined(QuadDec_M2_GetCounter)
@@ -84,6 +184,38 @@ static inline void enc_accumulate_now(void)
     if (dL < 0) dL = -dL;
     if (dR < 0) dR = -dR;
     s_acc_ticks += (dL + dR);
+    return dL + dR;
+}
+
+/* ---------------- Timed states ----------------
+ * Each state remembers when it started; Directions_Handle() checks the clock
+ * on every call instead of sleeping, so the main loop keeps reading sensors
+ * and serving USB while the robot stops, brakes or kicks.
+ */
+static inline uint32_t state_ms(void)
+{
+    return (DWT->CYCCNT - s_t0) / CYC_PER_MS;
+}
+
+static void enter_state(dir_state_t st, uint16_t wait_ms)
+{
+    s_state = st;
+    s_wait_ms = wait_ms;
+    s_t0 = DWT->CYCCNT;
+    s_moved_at = s_t0;
+}
+
+/* 1 once the timed state is over: its full time, or the wheels have been
+ * still for STILL_MS (after SETTLE_MIN_MS) */
+static uint8_t settled(void)
+{
+    if (enc_accumulate_now() > STILL_COUNTS) {
+        s_moved_at = DWT->CYCCNT;
+    }
+    uint32_t ms = state_ms();
+    if (ms >= s_wait_ms) return 1u;
+    return (ms >= SETTLE_MIN_MS &&
+            (DWT->CYCCNT - s_moved_at) / CYC_PER_MS >= STILL_MS) ? 1u : 0u;
 }
 
 /* ---------------- Motor helpers (spin-in-place) ----------------
@@ -111,6 +243,7 @@ static void pivot_right_speed(void)
     set_motors_with_trim_and_steer(base, steer);
 }
 
+#if !PIVOT_PROFILE
 static void pivot_uturn_speed(void)
 {
     const int pct = PIVOT_SPEED_U;
@@ -122,29 +255,181 @@ static void pivot_uturn_speed(void)
 }
 
 
-/* Ensure we always exit cleanly and release to straight */
-static void finish_and_release(volatile uint8_t* p_dir)
+static void pivot_drive(uint8_t side)
 {
-    /* Give counters back to the background task */
-    enc_resume_background();
-    enc_reset_local();
+    if (side == 1u) {
+        pivot_left_speed();
+    } else if(side == 2u) {
+        pivot_right_speed();
+    } else if(side == 3u) {
+        pivot_uturn_speed();
+    }
+}
+#endif
+
+#if PIVOT_PROFILE
+/* Spin at pct duty (left turns spin left, right and U-turns spin right) */
+static void pivot_drive_pct(uint8_t side, int pct)
+{
+    int L = (side == 1u) ? -pct : +pct;
+    int R = -L;
+    int base  = (L + R) / 2;
+    int steer = (R - L) / 2;
+    set_motors_with_trim_and_steer(base, steer);
+}
+
+static int32_t isqrt32(uint32_t x)
+{
+    uint32_t r = 0, bit = 1uL << 30;
+    while (bit > x) bit >>= 2;
+    while (bit) {
+        if (x >= r + bit) { x -= r + bit; r = (r >> 1) + bit; }
+        else              { r >>= 1; }
+        bit >>= 2;
+    }
+    return (int32_t)r;
+}
+
+static void profile_start(void)
+{
+    s_prof_cyc = DWT->CYCCNT;
+    s_w_ref = 0;
+    s_w_f = 0;
+    s_w_i_q8 = 0;
+}
+
+/* One profile step, step = counts since the last call; returns duty % */
+static int profile_duty(int32_t step)
+{
+    uint32_t now = DWT->CYCCNT;
+    int32_t dt_us = (int32_t)((now - s_prof_cyc) / CYC_PER_US);
+    s_prof_cyc = now;
+    if (dt_us > 100000) dt_us = 100000;
+
+    /* Measured rate, half-way filtered against the 1-count quantisation */
+    if (dt_us > 0) {
+        int32_t w = (step * 1000000) / dt_us;
+        s_w_f += (w - s_w_f) / 2;
+    }
+
+    /* Reference: ramp up, cruise, and the braking curve onto the stop point */
+    const int32_t w_max = (s_turn_side == 3u) ? PIVOT_W_MAX_U : PIVOT_W_MAX;
+    int32_t stop = (s_lead_at >= 0) ? s_lead_at + PIVOT_PITCH_TICKS : s_target_ticks;
+    int32_t left = stop - s_coast[s_turn_side - 1u] - s_acc_ticks;
+    if (left < 0) left = 0;
+    int32_t w_dec = isqrt32((uint32_t)(2 * PIVOT_DEC * left));
+
+    s_w_ref += (PIVOT_ACC * dt_us) / 1000000;
+    if (s_w_ref > w_max) s_w_ref = w_max;
+    if (s_w_ref > w_dec) s_w_ref = w_dec;
+    if (s_w_ref < PIVOT_W_MIN) s_w_ref = PIVOT_W_MIN;
+
+    /* Feed-forward + PI on the rate */
+    int32_t e = s_w_ref - s_w_f;
+    int32_t i_nx = s_w_i_q8 + (e * PIVOT_KI_Q8) * (dt_us / 100) / 10000;
+    if (i_nx >  PIVOT_I_LIM * 256) i_nx =  PIVOT_I_LIM * 256;
+    if (i_nx < -PIVOT_I_LIM * 256) i_nx = -PIVOT_I_LIM * 256;
+    s_w_i_q8 = i_nx;
+
+    int32_t duty = PIVOT_DUTY_STATIC + s_w_ref / PIVOT_W_PER_PCT + (e * PIVOT_KP_Q8 + i_nx) / 256;
+    if (duty < 0) duty = 0;                  /* no reverse torque: the brake window stops it */
+    if (duty > PIVOT_DUTY_MAX) duty = PIVOT_DUTY_MAX;
+    return (int)duty;
+}
+#endif
+
+/* End of the pivot: stop and start the brake window */
+static void begin_brake(void)
+{
+    set_motors_symmetric(0);
+    enter_state(DIR_BRAKE, BRAKE_AFTER_MS);
+}
 
-    /* Release to straight and reset our state machine */
+/* 1 when the pivot should be cut now (see PIVOT_SENSOR_STOP) */
+static uint8_t pivot_cut_now(void)
+{
+    const int32_t coast = s_coast[s_turn_side - 1u];
+#if PIVOT_SENSOR_STOP
+    const uint8_t lead = (s_turn_side == 1u) ? 0x08u : 0x20u;   /* S4 / S6 */
+    const uint8_t line = Sensor_LineState();
+
+    if (s_acc_ticks * 100 >= s_target_ticks * PIVOT_WIN_HI_PCT - coast * 100) return 1u;
+    if (s_acc_ticks * 100 < s_target_ticks * PIVOT_WIN_LO_PCT) return 0u;
+
+    if (line & 0x10u) return 1u;                                 /* already on S5 */
+    if (s_lead_at < 0 && (line & lead)) s_lead_at = s_acc_ticks;
+    return (s_lead_at >= 0 && s_acc_ticks >= s_lead_at + PIVOT_PITCH_TICKS - coast) ? 1u : 0u;
+#else
+    return (s_acc_ticks >= s_target_ticks - coast) ? 1u : 0u;
+#endif
+}
+
+/* After the brake window: fold the measured coast into the average */
+static void learn_coast(void)
+{
+    if (s_cut_at < 0 || s_turn_side < 1u || s_turn_side > 3u) return;
+    int32_t c = s_acc_ticks - s_cut_at;
+    if (c < 0) c = 0;
+    if (c > PIVOT_COAST_MAX) c = PIVOT_COAST_MAX;
+    int32_t* avg = &s_coast[s_turn_side - 1u];
+    *avg += (c - *avg) / 4;
+}
+
+/* Release to straight and reset our state machine, motors untouched */
+static void release(volatile uint8_t* p_dir)
+{
+    s_last_kind = s_kind;
+    s_kind = LEARN_NONE;
     if (p_dir) *p_dir = 0u;
     s_state = DIR_IDLE;
     s_turn_side = 0u;
     s_target_ticks = 0;
     s_acc_ticks = 0;
     s_safety_count = 0;
-    
-    /* Stop motion and brief brake/coast window */
-    set_motors_symmetric(0); 
-    CyDelay(BRAKE_AFTER_MS);
+}
+
+/* Ensure we always exit cleanly and release to straight. The counters are
+ * not cleared here: the background task folds the kick into the odometer. */
+static void finish_and_release(volatile uint8_t* p_dir)
+{
     set_motors_symmetric(0);
 
-    set_motors_with_trim_and_steer(100,-10);
-    CyDelay(60);
-    set_motors_symmetric(0); 
+    /* Give counters back to the background task */
+    enc_resume_background();
+
+    release(p_dir);
+}
+
+/* Arc wheel speeds from the current speed and ARC_RADIUS_MM */
+static void arc_start(uint8_t req)
+{
+    int32_t v = (Wheel_SpeedMmS(WHEEL_LEFT) + Wheel_SpeedMmS(WHEEL_RIGHT)) / 2;
+    if (v < ARC_V_MIN_MM_S) v = ARC_V_MIN_MM_S;
+    if (v > ARC_V_MAX_MM_S) v = ARC_V_MAX_MM_S;
+
+    const int32_t b = ARC_TRACK_MM / 2;
+    int32_t v_in  = v * (ARC_RADIUS_MM - b) / ARC_RADIUS_MM;
+    int32_t v_out = v * (ARC_RADIUS_MM + b) / ARC_RADIUS_MM;
+
+    s_turn_side = (req == DIR_ARC_LEFT) ? 1u : 2u;
+    s_arc_vl = (s_turn_side == 1u) ? v_in : v_out;
+    s_arc_vr = (s_turn_side == 1u) ? v_out : v_in;
+    s_kind = (uint8_t)(((v < ARC_V_SPLIT_MM_S) ? DIR_LEARN_ARC_SLOW : DIR_LEARN_ARC_FAST) + s_turn_side - 1u);
+    s_target_ticks = s_learned[s_kind];
+    s_arc_abs0 = Wheel_AbsTicks();
+    enter_state(DIR_ARC, ARC_MAX_MS);
+}
+
+/* 1 when the arc is over: on the new line, past ARC_OVER_PCT or timed out */
+static uint8_t arc_done(void)
+{
+    int32_t turned = (int32_t)((Wheel_AbsTicks() - s_arc_abs0) * (uint32_t)(ARC_TRACK_MM / 2)
+                               / (uint32_t)ARC_RADIUS_MM);
+
+    if (turned * 100 >= s_target_ticks * ARC_OVER_PCT) return 1u;
+    if (state_ms() >= s_wait_ms) return 1u;
+    return (turned * 100 >= s_target_ticks * ARC_EXIT_PCT &&
+            (Sensor_LineState() & ARC_EXIT_MASK) != 0u) ? 1u : 0u;
 }
 
 /* ======================= Public API ======================= */
@@ -156,6 +441,61 @@ void Directions_Init(void)
     s_target_ticks = 0;
     s_acc_ticks = 0;
     s_safety_count = 0;
+    s_wait_ms = 0;
+    s_kind = LEARN_NONE;
+    s_last_kind = LEARN_NONE;
+    for (uint8_t k = 0; k < DIR_LEARN_N; k++) s_learned[k] = (uint8_t)learn_base(k);
+    s_learn_count = 0;
+}
+
+void Directions_Learn(int16_t line_mrad)
+{
+    const uint8_t k = s_last_kind;
+    s_last_kind = LEARN_NONE;                  /* one report per turn */
+    if (k >= DIR_LEARN_N) return;
+    if (line_mrad > LEARN_MAX_MRAD || line_mrad < -LEARN_MAX_MRAD) return;
+
+    /* Turned too far left = the line bends to +x; left kinds are even */
+    int32_t over = (k == DIR_LEARN_U || (k & 1u)) ? -line_mrad : line_mrad;
+    if (over < LEARN_DEADBAND_MRAD && over > -LEARN_DEADBAND_MRAD) return;
+
+    const int32_t base = learn_base(k);
+    const int32_t angle_mrad = (k == DIR_LEARN_U) ? 3142 : 1571;
+    int32_t step = (over * base * LEARN_PCT) / (angle_mrad * 100);
+    if (step >  LEARN_STEP_MAX) step =  LEARN_STEP_MAX;
+    if (step < -LEARN_STEP_MAX) step = -LEARN_STEP_MAX;
+
+    int32_t t = (int32_t)s_learned[k] - step;
+    if (t < base / 2) t = base / 2;
+    if (t > base + base / 2) t = base + base / 2;
+    if (t > 255) t = 255;
+    s_learned[k] = (uint8_t)t;
+    s_learn_count++;
+}
+
+uint16_t Directions_GetLearned(uint8_t* t)
+{
+    for (uint8_t k = 0; k < DIR_LEARN_N; k++) t[k] = s_learned[k];
+    return s_learn_count;
+}
+
+void Directions_SetLearned(const uint8_t* t)
+{
+    for (uint8_t k = 0; k < DIR_LEARN_N; k++) {
+        int32_t base = learn_base(k);
+        if (t[k] >= base / 2 && t[k] <= base + base / 2) s_learned[k] = t[k];
+    }
+}
+
+void Directions_Pivot(uint8_t side)
+{
+    if (side == 1u) {
+        pivot_left_speed();
+    } else if (side == 2u) {
+        pivot_right_speed();
+    } else {
+        set_motors_symmetric(0);
+    }
 }
 
 void Directions_Handle(volatile uint8_t* p_dir)
@@ -165,78 +505,87 @@ void Directions_Handle(volatile uint8_t* p_dir)
     switch (s_state)
     {
     case DIR_IDLE:
-        if (req == 1u) {
-            /* Stop, settle, pause encoders, zero counters */
-            set_motors_symmetric(0);
-            motor_enable(0u, 0u);
-            CyDelay(STOP_BEFORE_MS+40);
-
-            //enc_pause_background();
-            enc_reset_local();
-
-            s_turn_side = req; /* latch side */
-            s_target_ticks = (req == 1u) ? TICKS_90_LEFT : TICKS_90_RIGHT;
-            s_acc_ticks = 0;
-            s_safety_count = 0;
-            s_state = DIR_TURNING;
-        } else if (req == 2u) {
-            /* Stop, settle, pause encoders, zero counters */
-            set_motors_symmetric(0);
-            motor_enable(0u, 0u);
-            CyDelay(STOP_BEFORE_MS);
-
-            //enc_pause_background();
-            enc_reset_local();
-
-            s_turn_side = req; /* latch side */
-            s_target_ticks = (req == 1u) ? TICKS_90_LEFT : TICKS_90_RIGHT;
-            s_acc_ticks = 0;
-            s_safety_count = 0;
-            s_state = DIR_TURNING;
-        } else if (req == 3u){
+        if (req == 1u || req == 2u || req == 3u) {
+            /* Stop and start the settle window */
             set_motors_symmetric(0);
             motor_enable(0u, 0u);
-            CyDelay(STOP_BEFORE_MS);
 
             //enc_pause_background();
             enc_reset_local();
 
             s_turn_side = req; /* latch side */
-            s_target_ticks = (req == 1u) ? TICKS_90_LEFT : TICKS_90_RIGHT;
+            s_kind = (req == 1u) ? DIR_LEARN_PIVOT_L : (req == 2u) ? DIR_LEARN_PIVOT_R : DIR_LEARN_U;
+            s_target_ticks = s_learned[s_kind];
             s_acc_ticks = 0;
             s_safety_count = 0;
-            s_state = DIR_TURNING;
+            s_lead_at = -1;
+            s_cut_at = -1;
+            enter_state(DIR_SETTLE, (req == 1u) ? (STOP_BEFORE_MS + 40) : STOP_BEFORE_MS);
+        } else if (DIR_IS_ARC(req)) {
+            arc_start(req);
+            Wheel_Drive(s_arc_vl, s_arc_vr);
         }
         break;
 
-    case DIR_TURNING:
-        /* Drive the pivot */
-        if (s_turn_side == 1u) {
-            pivot_left_speed();
-        } else if(s_turn_side == 2u) {
-            pivot_right_speed();
-        } else if(s_turn_side == 3u) {
-            pivot_uturn_speed();
+    case DIR_ARC:
+        /* Hand over to the line follower still moving: no stop, no kick */
+        if (arc_done()) {
+            release(p_dir);
+            break;
         }
+        Wheel_Drive(s_arc_vl, s_arc_vr);
+        break;
 
+    case DIR_SETTLE:
+        if (!settled()) break;
+        /* Stopped: zero the counters and start turning in this same call */
+        enc_reset_local();
+#if PIVOT_PROFILE
+        profile_start();
+#endif
+        s_state = DIR_TURNING;
+        /* fall through */
 
-        /* Progress + safety */
-        enc_accumulate_now();
-        if (++s_safety_count > MAX_TURN_HANDLER_TICKS) {
-            /* Fail-safe: bail out even if encoders misbehave */
-            finish_and_release(p_dir);
+    case DIR_TURNING:
+    {
+        /* Progress, then drive the pivot */
+        int32_t step = enc_accumulate_now();
+#if PIVOT_PROFILE
+        pivot_drive_pct(s_turn_side, profile_duty(step));
+#else
+        (void)step;
+        pivot_drive(s_turn_side);
+#endif
+
+        /* Safety */
+        if (++s_safety_count > ((s_turn_side == 3u) ? 2u * MAX_TURN_HANDLER_TICKS : MAX_TURN_HANDLER_TICKS)) {
+            /* Fail-safe: bail out even if encoders misbehave (nothing to learn) */
+            s_kind = LEARN_NONE;
+            begin_brake();
             break;
         }
 
         /* Done? */
-        if (s_acc_ticks >= s_target_ticks) {
-            s_state = DIR_FINISH;
+        if (pivot_cut_now()) {
+            s_cut_at = s_acc_ticks;
+            begin_brake();
         }
         break;
+    }
 
-    case DIR_FINISH:
-        /* One last stop; then release to straight */
-        finish_and_release(p_dir);
+    case DIR_BRAKE:
+        if (!settled()) break;
+        learn_coast();
+        /* Counts from here on belong to the odometer */
+        enc_reset_local();
+        set_motors_with_trim_and_steer(100,-10);
+        enter_state(DIR_KICK, KICK_MS);
+        break;
+
+    case DIR_KICK:
+        if (state_ms() >= s_wait_ms) {
+            finish_and_release(p_dir);
+        }
         break;
 
     default:
@@ -244,4 +593,4 @@ void Directions_Handle(volatile uint8_t* p_dir)
         finish_and_release(p_dir);
         break;
     }
-}
\ No newline at end of file
+}
@@ -3,18 +3,65 @@
 #include <stdbool.h>
 
 /* External interface:
- * - g_direction: 0 = straight, 1 = request LEFT pivot, 2 = request RIGHT pivot
+ * - g_direction: 0 = straight, 1 = request LEFT pivot, 2 = request RIGHT pivot,
+ *   3 = U-turn, DIR_ARC_LEFT / DIR_ARC_RIGHT = arc turn at speed
  * - Directions_Init(): call once at startup
- * - Directions_Handle(&g_direction): call every loop; it will block-run the pivot
- *   and set *g_direction back to 0 when the encoder target is reached.
+ * - Directions_Handle(&g_direction): call every loop tick; it never blocks.
+ *   Stop/settle, pivot, brake and kick are timed states advanced on each call,
+ *   and *g_direction goes back to 0 once the kick has finished.
  */
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Arc turns: no stop, the wheels follow v*(R -/+ b)/R around a circle of
+ * ARC_RADIUS_MM through the axle centre (b = half the track), at the speed
+ * the robot had when the arc started. The encoder task keeps counting
+ * (odometry and Wheel_Drive()), and the arc hands over to the line
+ * follower as soon as a steering sensor sees the new line. Progress comes
+ * from Wheel_AbsTicks(), so it does not depend on the encoder signs. */
+#define DIR_ARC_LEFT           4u
+#define DIR_ARC_RIGHT          5u
+#define DIR_IS_ARC(d)          ((d) == DIR_ARC_LEFT || (d) == DIR_ARC_RIGHT)
+
+/* Radius: as small as the inner wheel allows (b + 3 mm, inner wheel at
+ * 0.1 v), because the arc cannot start before the junction is confirmed and
+ * every mm of radius past the remaining lead ends up as offset from the new
+ * line (main.c checks that against the S4..S6 span). */
+#define ARC_RADIUS_MM          30
+#define ARC_TRACK_MM           54     /* wheel to wheel, ~2 x TICKS_90 x 0.94 mm / pi */
+#define ARC_S12_AXLE_MM        20     /* S1/S2 ahead of the axle */
+
+#if (2 * ARC_RADIUS_MM) <= ARC_TRACK_MM
+#error "ARC_RADIUS_MM must exceed half of ARC_TRACK_MM (inner wheel would reverse)"
+#endif
+
 void Directions_Init(void);
 void Directions_Handle(volatile uint8_t* p_dir);
 
+/* Open-loop pivot outside the state machine (1 = left, 2 = right, anything else stops).
+ * Used by the sensor calibration sweep. */
+void Directions_Pivot(uint8_t side);
+
+/* Learned turn targets (encoder counts), one per kind: */
+#define DIR_LEARN_PIVOT_L      0u
+#define DIR_LEARN_PIVOT_R      1u
+#define DIR_LEARN_ARC_SLOW     2u      /* + 0 left, + 1 right */
+#define DIR_LEARN_ARC_FAST     4u
+#define DIR_LEARN_U            6u
+#define DIR_LEARN_N            7u
+
+/* Line angle seen just after the last turn (mrad, + = the line bends to +x,
+ * i.e. towards S6); moves that turn's target. Call once per turn. */
+void Directions_Learn(int16_t line_mrad);
+
+/* Copy the targets out (t[DIR_LEARN_N]); returns how many updates there
+ * have been since Directions_Init() */
+uint16_t Directions_GetLearned(uint8_t* t);
+
+/* Replace the targets, e.g. from EEPROM; out-of-range entries are ignored */
+void Directions_SetLearned(const uint8_t* t);
+
 #ifdef __cplusplus
 }
 #endif
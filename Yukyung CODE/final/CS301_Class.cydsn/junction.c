@@ -0,0 +1,116 @@
+#include <stdint.h>
+
+#include "junction.h"
+
+/* ===================== State ===================== */
+typedef struct {
+    int32_t odo_mm;
+    uint8_t mask;
+} jn_sample_t;
+
+static jn_sample_t s_hist[JUNCTION_HIST];
+static uint8_t  s_wr = 0, s_n = 0;
+
+static int32_t  s_arm_mm = 0;        /* quiet until here */
+static uint8_t  s_open = 0;          /* S1/S2 seen, window running */
+static int32_t  s_open_mm = 0;
+static uint8_t  s_open_n = 0;        /* samples since the window opened */
+static uint8_t  s_dark = 0;          /* steering sensors all off since s_dark_mm */
+static int32_t  s_dark_mm = 0;
+static uint8_t  s_dead_sent = 0;
+static junction_t s_last;
+
+void Junction_Reset(int32_t odo_mm)
+{
+    s_wr = 0;
+    s_n = 0;
+    s_arm_mm = odo_mm + JUNCTION_ARM_MM;
+    s_open = 0u;
+    s_dark = 0u;
+    s_dead_sent = 0u;
+}
+
+/* Label the window that opened at s_open_mm from the samples since then */
+static void classify(junction_t* ev)
+{
+    uint8_t hl = 0, hr = 0, ahead = 0;
+    int32_t first = 0, last = 0;
+    uint8_t any = 0;
+    uint8_t n = (s_open_n < s_n) ? s_open_n : s_n;
+    uint8_t min_hits = (uint8_t)((n + 1u) / 2u);     /* >= 1: the opening sample */
+
+    for (uint8_t k = 0; k < n; k++) {
+        /* newest first */
+        const jn_sample_t* sm = &s_hist[(uint8_t)(s_wr - 1u - k) & (JUNCTION_HIST - 1u)];
+
+        if (k < n / 2u && (sm->mask & JUNCTION_S3)) ahead = 1u;
+        if (sm->mask & (JUNCTION_S1 | JUNCTION_S2)) {
+            if (!any) { last = sm->odo_mm; any = 1u; }
+            first = sm->odo_mm;
+        }
+        if (sm->mask & JUNCTION_S1) hl++;
+        if (sm->mask & JUNCTION_S2) hr++;
+    }
+
+    uint8_t left  = (hl >= min_hits) ? 1u : 0u;
+    uint8_t right = (hr >= min_hits) ? 1u : 0u;
+
+    ev->type     = (left && right) ? JUNCTION_CROSS
+                 : left            ? JUNCTION_T_LEFT
+                 : right           ? JUNCTION_T_RIGHT
+                 :                   JUNCTION_FALSE;
+    ev->ahead    = ahead;
+    ev->hits_l   = hl;
+    ev->hits_r   = hr;
+    ev->at_mm    = s_open_mm;
+    ev->width_mm = (uint16_t)(last - first);
+}
+
+uint8_t Junction_Update(uint8_t line_mask, int32_t odo_mm, junction_t* ev)
+{
+    s_hist[s_wr].odo_mm = odo_mm;
+    s_hist[s_wr].mask   = line_mask;
+    s_wr = (uint8_t)((s_wr + 1u) & (JUNCTION_HIST - 1u));
+    if (s_n < JUNCTION_HIST) s_n++;
+
+    if (odo_mm < s_arm_mm) return 0u;
+
+    /* dead end: the line just stops under the steering sensors */
+    if ((line_mask & JUNCTION_STEER_MASK) == 0u && !s_open) {
+        if (!s_dark) { s_dark = 1u; s_dark_mm = odo_mm; }
+        if (!s_dead_sent && odo_mm - s_dark_mm >= JUNCTION_DEADEND_MM) {
+            s_dead_sent = 1u;
+            ev->type = JUNCTION_DEAD_END;
+            ev->ahead = 0u;
+            ev->hits_l = ev->hits_r = 0u;
+            ev->at_mm = s_dark_mm;
+            ev->width_mm = 0u;
+            s_last = *ev;
+            return 1u;
+        }
+    } else {
+        s_dark = 0u;
+        s_dead_sent = 0u;
+    }
+
+    if (!s_open) {
+        if (line_mask & (JUNCTION_S1 | JUNCTION_S2)) {
+            s_open = 1u;
+            s_open_mm = odo_mm;
+            s_open_n = 1u;
+        }
+        return 0u;
+    }
+    if (s_open_n < 0xFFu) s_open_n++;
+    if (odo_mm - s_open_mm < JUNCTION_WINDOW_MM || s_open_n < JUNCTION_WINDOW_N) return 0u;
+
+    s_open = 0u;
+    classify(ev);
+    s_last = *ev;
+    return 1u;
+}
+
+const junction_t* Junction_Last(void)
+{
+    return &s_last;
+}
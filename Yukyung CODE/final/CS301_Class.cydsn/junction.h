@@ -0,0 +1,61 @@
+#pragma once
+#include <stdint.h>
+
+/* Junction classifier. Fed the on-line state of all six sensors and the
+ * odometer every loop on a straight; once S1 (left) or S2 (right) has been
+ * on the line, it looks JUNCTION_WINDOW_MM and at least JUNCTION_WINDOW_N
+ * samples further and labels the event from the recorded history:
+ *   T_LEFT / T_RIGHT : a branch on one side
+ *   CROSS            : branches on both sides (ahead = 0: the top of a T)
+ *   DEAD_END         : every steering sensor dark for JUNCTION_DEADEND_MM
+ *   FALSE            : S1/S2 on the line in fewer than half the window samples
+ * ahead says whether S3 still had the line in the newer half of the window.
+ *
+ * The main loop runs at ~28 ms (LOOP_DT_MS 8 + the 20 ms sensor window), so
+ * at 200 mm/s a sample is ~5.6 mm and 15 mm alone would be 2..3 samples: the
+ * sample floor keeps one missed read from deciding the label, and both
+ * thresholds are taken from the samples the window actually holds. */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JUNCTION_NONE          0u
+#define JUNCTION_T_LEFT        1u
+#define JUNCTION_T_RIGHT       2u
+#define JUNCTION_CROSS         3u
+#define JUNCTION_DEAD_END      4u
+#define JUNCTION_FALSE         5u
+
+#define JUNCTION_HIST         32u      /* samples kept (power of two) */
+#define JUNCTION_WINDOW_MM    15       /* past the first S1/S2 hit */
+#define JUNCTION_WINDOW_N      4u      /* and at least this many samples (< JUNCTION_HIST) */
+#define JUNCTION_DEADEND_MM   30
+#define JUNCTION_ARM_MM       30       /* quiet after Junction_Reset(): the exit of a
+                                        * turn or junction still crosses S1/S2 */
+
+/* Sensor bits of line_mask (bit 0 = S1, as Sensor_LineState()) */
+#define JUNCTION_S1            0x01u
+#define JUNCTION_S2            0x02u
+#define JUNCTION_S3            0x04u
+#define JUNCTION_STEER_MASK    0x3Cu   /* S3..S6 */
+
+typedef struct {
+    uint8_t  type;             /* JUNCTION_* */
+    uint8_t  ahead;            /* line continues straight on */
+    uint8_t  hits_l, hits_r;   /* samples with S1 / S2 on the line */
+    int32_t  at_mm;            /* odometer at the first S1/S2 hit (dark start for DEAD_END) */
+    uint16_t width_mm;         /* first to last side hit */
+} junction_t;
+
+/* Start of a straight: forget the history, stay quiet for JUNCTION_ARM_MM */
+void Junction_Reset(int32_t odo_mm);
+
+/* One loop; returns 1 and fills ev when an event has been classified */
+uint8_t Junction_Update(uint8_t line_mask, int32_t odo_mm, junction_t* ev);
+
+/* Last classified event (type JUNCTION_NONE before the first) */
+const junction_t* Junction_Last(void);
+
+#ifdef __cplusplus
+}
+#endif
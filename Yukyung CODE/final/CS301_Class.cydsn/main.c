@@ -8,9 +8,17 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-#include <sensors.h>     // Sensor_ComputePeakToPeak()
+#include <sensors.h>     // Sensor_Init(), Sensor_ComputePeakToPeak*()
 #include "motor_s.h"     // set_motors_*, motor_enable
 #include "directions.h"  // Directions_* turning module
+#include "calib.h"       // Calib_Run() per-sensor thresholds
+#include "usblog.h"      // USBLog_* capture dump over USBUART
+#include "steer.h"       // Steer_* fixed-point PI
+#include "wheel.h"       // Wheel_* per-wheel speed loops
+#include "recover.h"     // Recover_* line-loss search
+#include "nvm.h"         // NVM_* EEPROM records
+#include "autotune.h"    // Autotune_* relay experiment
+#include "junction.h"    // Junction_* intersection classifier
 
 
 /* ===== Loop pacing (kept) ===== */
@@ -23,6 +31,12 @@
 #define V_CRUISE_MM_S  ((int32_t)VMAX_CONST_MM_S * (int32_t)SPEED_FRAC_PERCENT / 100)
 #define TARGET_DIST_MM        150  
 
+/* Cascaded drive: the steering output becomes a yaw-rate command, expressed as
+ * the left/right wheel-speed difference it takes (1 % steer = VMAX_CONST_MM_S / 100),
+ * and per-wheel PI loops track V_CRUISE_MM_S -/+ that difference from the
+ * encoders. 0 = open-loop center_duty_est + steer duty with RIGHT_TRIM_PERCENT. */
+#define SPEED_LOOP               1
+
 /* ===== Encoder → mm conversion (kept) ===== */
 #define QD_SAMPLE_MS             5u
 #define CPR_OUTSHAFT           228u
@@ -33,10 +47,11 @@
 #define CALIB_DIST_X1000     1000   // Changed to 1000 to avoid scaling
 #define APPLY_CALIB_DIST(x)  ( (int32_t)(((int64_t)(x) * CALIB_DIST_X1000 + 500)/1000) )
 
-/* ===== S1/S2 relaxed detection (kept) ===== */
-#define S_MINC_COUNTS            10
-#define S_MAXC_COUNTS           100
+/* ===== S1/S2 relaxed detection (kept) =====
+ * S_MINC_COUNTS / S_MAXC_COUNTS live in sensors.h (the adaptive sampler uses them too)
+ * and are only the defaults: the startup sweep replaces them per channel */
 #define S_HYST_COUNTS           16u
+#define CALIB_AT_STARTUP         1
 
 /* ===== Turn request filtering (kept) ===== */
 #define TURN_DEBOUNCE_TICKS       5u
@@ -45,12 +60,46 @@
 #define DIR_CALL_DELAY_MS        (100)  /* wait ~200 ms before starting the maneuver */
 #define DIR_CALL_DELAY_TICKS     ((DIR_CALL_DELAY_MS + LOOP_DT_MS - 1) / LOOP_DT_MS)
 
-
-// Cooldown after turn to ignore intersection sensors V1 & V2
- #define TURN_COOLDOWN_MS (400)
-//static volatile uint16_t TURN_COOLDOWN_MS;
-
-#define TURN_COOLDOWN_TICKS ((TURN_COOLDOWN_MS + LOOP_DT_MS - 1) / LOOP_DT_MS
+/* Pivot start point: distance past the timestamped S1/S2 edge.
+ * DIR_CALL_DELAY_TICKS is only used when no edge was recorded. */
+#define DIR_CALL_DIST_MM         20     /* = 100 ms at V_CRUISE_MM_S */
+
+/* Left/right commands: 1 = arc through the junction at speed (ARC_RADIUS_MM
+ * in directions.h), 0 = stop and pivot. U-turns always pivot.
+ *
+ * The arc can start no earlier than the end of the straight, i.e. when
+ * junction.c has labelled the junction ARC_CONFIRM_MM past the S1/S2 edge
+ * (its window, or JUNCTION_WINDOW_N loops of travel if that is longer).
+ * The branch is then ARC_LEAD_MM ahead of the axle, and a quarter circle
+ * started there ends ARC_EXIT_OFF_MM = R - lead off the new line, which has
+ * to be inside the S4..S6 span, with half a pitch to spare, for the line
+ * follower to take over. With S1/S2 20 mm ahead of the axle the lead is
+ * ~2 mm and the offset ~28 mm against 15 mm, so arcs stay off until the
+ * sensor bar moves forward or the junction is confirmed sooner. No lap
+ * comparison against the pivots has been run yet either. */
+#define ARC_TURNS                0
+#define ARC_MM_PER_LOOP          ((VMAX_CONST_MM_S * SPEED_FRAC_PERCENT / 100 * (LOOP_DT_MS + SENSOR_WINDOW_MS) + 999) / 1000)
+#define ARC_CONFIRM_MM           ((JUNCTION_WINDOW_MM > (JUNCTION_WINDOW_N - 1) * ARC_MM_PER_LOOP) ? \
+                                  JUNCTION_WINDOW_MM : (JUNCTION_WINDOW_N - 1) * ARC_MM_PER_LOOP)
+#define ARC_LEAD_MM              (ARC_S12_AXLE_MM - ARC_CONFIRM_MM)
+#define ARC_EXIT_OFF_MM          (ARC_RADIUS_MM - ARC_LEAD_MM)
+/* start point past the edge: R before the branch, or at once if that is already behind */
+#define ARC_START_MM             ((ARC_LEAD_MM > ARC_RADIUS_MM) ? (ARC_S12_AXLE_MM - ARC_RADIUS_MM) : 0)
+#if ARC_TURNS && (ARC_EXIT_OFF_MM > STEER_X_MAX_MM - STEER_ROW_PITCH_MM / 2)
+#error "arc would end outside the S4..S6 span: move S1/S2 forward or confirm junctions sooner"
+#endif
+#if ARC_TURNS
+#define TURN_REQ_LEFT            DIR_ARC_LEFT
+#define TURN_REQ_RIGHT           DIR_ARC_RIGHT
+#else
+#define TURN_REQ_LEFT            1u
+#define TURN_REQ_RIGHT           2u
+#endif
+
+/* Junctions are labelled by junction.c from the S1..S6 history and the
+ * odometer; after a turn it stays quiet for JUNCTION_ARM_MM instead of a
+ * per-index cooldown. A FALSE label does not end the straight, a DEAD_END
+ * only does before a U-turn. */
 
 
 
@@ -61,27 +110,41 @@ static uint8_t sen4_on_line=0, sen5_on_line=0, sen6_on_line=0;
 /* ===== Global state (kept) ===== */
 static volatile uint8_t g_direction = 0;   /* 0=straight, 1=left, 2=right */
 static volatile uint8_t g_stop_now  = 0;
-static volatile int32_t g_dist_mm   = 0;
+volatile int32_t g_dist_mm          = 0;   /* shared with sensors.c edge events */
+
+/* ===== Food stops =====
+ * Stand still FOOD_STOP_MS once, when the mission index reaches a food point
+ * (the command after a REACH straight). A state of its own, so the
+ * non-blocking turn steps around it are never held up. */
+#define FOOD_STOP_MS          2000u
+#define FOOD_STOP_TICKS       ((FOOD_STOP_MS + LOOP_DT_MS - 1u) / LOOP_DT_MS)
+#define IS_FOOD_INDEX(k)      ((k) == 13 || (k) == 23 || (k) == 31 || (k) == 44)
+static uint16_t food_stop_ticks = 0;        /* countdown in loop ticks */
 
 /* ===== Option A state ===== */
 static uint16_t dir_delay_ticks = 0;        /* countdown in loop ticks */
-static uint8_t  dir_latched_side = 0;       /* remembers 1 or 2 while waiting */
+static uint8_t  dir_latched_side = 0;       /* remembers the request while waiting */
 
 
-static uint16_t turn_cooldown_ticks = 0;
-static uint8_t s12_prev = 0;
+/* Odometer reading at the last S1/S2 on-line edge */
+static int32_t s12_edge_mm = 0;
+static uint8_t s12_edge_valid = 0;
 
-static uint8_t left_sensor_count = 0;  // Counts left sensor detections
-static uint8_t right_sensor_count = 0; // Counts right sensor detections
+/* Channels whose last window was saturated or floating: read as 0 (off, no weight) */
+static uint8_t s_bad_mask = 0;
+
+/* Odometer reading where the current command started */
+static int32_t seg_start_mm = 0;
 
 
 
 /* ------------------------------- 5 ms Timer ISR: accumulate distance (kept) ------------------------------- */
 CY_ISR(isr_qd_Handler)
 {
-    if (g_direction == 0u) {  // Only accumulate distance when moving straight
+    if (g_direction == 0u || DIR_IS_ARC(g_direction)) {  // Only accumulate distance when not pivoting
         int32_t raw1 = QuadDec_M1_GetCounter();  QuadDec_M1_SetCounter(0);
         int32_t raw2 = QuadDec_M2_GetCounter();  QuadDec_M2_SetCounter(0);
+        Wheel_OnCounts(raw1, raw2);
 
         int32_t d1 = raw1, d2 = raw2;
         int32_t a1 = (d1 >= 0) ? d1 : -d1;
@@ -106,67 +169,79 @@ CY_ISR(isr_qd_Handler)
     (void)Timer_QD_ReadStatusRegister();  // Clear the interrupt flag
 }
 
-/* Utility: normalize peak-to-peak to [0..1] */
-static inline float norm01_from_pp(uint16_t pp)
+/* Odometer in mm: 5 ms total plus the counts it has not folded in yet (same rounding as the ISR) */
+static int32_t odo_mm(int32_t dist_mm, int16 m1, int16 m2)
+{
+    int32_t a1 = (m1 >= 0) ? m1 : -m1;
+    int32_t a2 = (m2 >= 0) ? m2 : -m2;
+    int32_t dmm_abs = (int32_t)(((int64_t)((a1 + a2) / 2) * MM_PER_COUNT_X1000 + 500) / 1000);
+    return dist_mm + (((int32_t)m1 + m2 >= 0) ? dmm_abs : -dmm_abs);
+}
+
+static int32_t odo_now_mm(void)
 {
-    if (pp <= S_MINC_COUNTS) return 0.0f;
-    if (pp >= S_MAXC_COUNTS) return 1.0f;
-    return (float)(pp - S_MINC_COUNTS) / (float)(S_MAXC_COUNTS - S_MINC_COUNTS);
+    uint8 is = CyEnterCriticalSection();
+    int32_t mm = odo_mm(g_dist_mm, QuadDec_M1_GetCounter(), QuadDec_M2_GetCounter());
+    CyExitCriticalSection(is);
+    return mm;
 }
 
-/* Read sensors and (maybe) request a turn based on S1 / S2 (kept) */
+/* 1 while the robot is still short of the pivot point */
+static uint8_t dir_call_waiting(void)
+{
+    if (s12_edge_valid) {
+        int32_t at_mm = DIR_IS_ARC(g_direction) ? ARC_START_MM : DIR_CALL_DIST_MM;
+        return (odo_now_mm() - s12_edge_mm < at_mm) ? 1u : 0u;
+    }
+    if (dir_delay_ticks > 0) {
+        dir_delay_ticks--;
+        return 1u;
+    }
+    return 0u;
+}
+
+/* Utility: normalize peak-to-peak to [0..1] across the channel's calibrated band */
+static inline float norm01_from_pp(uint8_t ch, uint16_t pp)
+{
+    return (float)Sensor_Normalize(ch, pp) * (1.0f / (float)SENSOR_NORM_ONE);
+}
+
+/* Read sensors (junctions are labelled by junction.c in the straight state) */
 static void light_sensors_update_and_maybe_request_turn(uint16_t* V3_pp, uint16_t* V4_pp, uint16_t* V5_pp, uint16_t* V6_pp)
 {
-    uint16_t V1 = Sensor_ComputePeakToPeak(0);
-    uint16_t V2 = Sensor_ComputePeakToPeak(1);
-    uint16_t V3 = Sensor_ComputePeakToPeak(2);
-    uint16_t V4 = Sensor_ComputePeakToPeak(3);
-    uint16_t V5 = Sensor_ComputePeakToPeak(4);
-    uint16_t V6 = Sensor_ComputePeakToPeak(5);
+    /* One window for all six channels */
+    uint16_t pp[SENSOR_NUM_CH];
+    (void)Sensor_ComputePeakToPeakAll(pp);
+
+    /* Drop readings the sensor layer does not trust (rail hit / open input) */
+    s_bad_mask = 0u;
+    for (uint8_t ch = 0; ch < SENSOR_NUM_CH; ch++) {
+        sensor_conf_t cf;
+        Sensor_GetConfidence(ch, &cf);
+        if (cf.flags & (SENSOR_CONF_SATURATED | SENSOR_CONF_FLOATING)) {
+            s_bad_mask |= (uint8_t)(1u << ch);
+            pp[ch] = 0u;
+        }
+    }
+    uint16_t V1 = pp[0];
+    uint16_t V2 = pp[1];
+    uint16_t V3 = pp[2];
+    uint16_t V4 = pp[3];
+    uint16_t V5 = pp[4];
+    uint16_t V6 = pp[5];
 
     if (V3_pp) *V3_pp = V3;
     if (V4_pp) *V4_pp = V4;
     if (V5_pp) *V5_pp = V5;
     if (V6_pp) *V6_pp = V6;
     
-    sen1_on_line = (V1 > 10 && V1 < 100) ? 1u : 0u;
-    sen2_on_line = (V2 > 10 && V2 < 100) ? 1u : 0u;
-    sen3_on_line = (V3 > 10 && V3 < 100) ? 1u : 0u;
-    sen4_on_line = (V4 > 10 && V4 < 100) ? 1u : 0u;
-    sen5_on_line = (V5 > 10 && V5 < 100) ? 1u : 0u;
-    sen6_on_line = (V6 > 10 && V6 < 100) ? 1u : 0u;
-
-    
-    if (sen1_on_line) {
-    if (left_sensor_count == 0) {
-        // First detection, ignore it (do nothing)
-        left_sensor_count = 1;  
-    } else if (left_sensor_count == 1) {
-        // Second detection, execute left turn
-        g_direction = 1;  // Left turn
-        left_sensor_count = 0;  // Reset counter after executing turn
-    }
-}
+    sen1_on_line = Sensor_IsOnLine(0, V1);
+    sen2_on_line = Sensor_IsOnLine(1, V2);
+    sen3_on_line = Sensor_IsOnLine(2, V3);
+    sen4_on_line = Sensor_IsOnLine(3, V4);
+    sen5_on_line = Sensor_IsOnLine(4, V5);
+    sen6_on_line = Sensor_IsOnLine(5, V6);
 
-// Check if the right sensor detects the line
-if (sen2_on_line) {
-    if (right_sensor_count == 0) {
-        // First detection, ignore it (do nothing)
-        right_sensor_count = 1;  
-    } else if (right_sensor_count == 1) {
-        // Second detection, execute right turn
-        g_direction = 2;  // Right turn
-        right_sensor_count = 0;  // Reset counter after executing turn
-    }
-}
-//    if (g_direction == 0u && turn_cooldown_ticks == 0u){
-//        if (sen1_on_line){
-//            g_direction = 1;  // LEFT turn
-//        } else if (sen2_on_line){
-//            g_direction = 2;  // RIGHT turn
-//        }
-//    }
-    (void)turn_cooldown_ticks;
 }
 
 /* ================= PI Controller (same as your current file) ================= */
@@ -181,10 +256,10 @@ static inline float _clampf(float x, float lo, float hi){ return (x<lo?lo:(x>hi?
 
 static int pi_step(pi_t* pi, uint16_t V3_pp, uint16_t V4_pp, uint16_t V5_pp, uint16_t V6_pp)
 {
-    float c3 = norm01_from_pp(V3_pp)*1.5f;
-    float c4 = norm01_from_pp(V4_pp)*1.5f;
-    float c5 = norm01_from_pp(V5_pp)*1.5f;
-    float c6 = norm01_from_pp(V6_pp)*1.5f;
+    float c3 = norm01_from_pp(2, V3_pp)*1.5f;
+    float c4 = norm01_from_pp(3, V4_pp)*1.5f;
+    float c5 = norm01_from_pp(4, V5_pp)*1.5f;
+    float c6 = norm01_from_pp(5, V6_pp)*1.5f;
     float sum = c4 + c5 + c6;
     bool valid = (sum > 0.08f);
 
@@ -218,14 +293,375 @@ static int pi_step(pi_t* pi, uint16_t V3_pp, uint16_t V4_pp, uint16_t V5_pp, uin
     return (int)(u + (u>=0?0.5f:-0.5f));
 }
 
+/* ================= Steering path selection ================= */
+/* The M3 has no FPU: pi_step() above is all soft-float calls, steer.c is the
+ * same controller in Q15 (outputs agree within 1 %, on rounding boundaries).
+ * STEER_PROFILE runs both every loop and leaves the cost in BCLK cycles and
+ * the worst output difference in the g_prof_* globals (debugger watch). */
+#define STEER_FIXED      1   /* 1 = steer.c Q15, 0 = float pi_step() */
+#define STEER_PROFILE    0
+
+/* Fixed path only: 1 = interpolated offset from V3..V6 (Steer_StepLine),
+ * 0 = the S4/S6 brightness centroid of pi_step(). The g_prof_max_diff
+ * comparison is only meaningful with 0 (and STEER_SCHEDULE 0). */
+#define STEER_INTERP     1
+
+/* Fixed path only: gains follow the measured forward speed through STEER_GAINS.
+ * The copies of this file were each tuned at one speed (KP 18 / STEER_MAX 11
+ * here at 200 mm/s, KP 16 / 15 elsewhere); the rows above 200 mm/s are a
+ * starting point that trades gain for steering authority as speed rises.
+ * 0 = KP / KI / STEER_MAX at every speed. */
+#define STEER_SCHEDULE   1
+
+/* Fixed path with STEER_INTERP only: heading-rate damping on top of the PI
+ * output, against how fast the measured line angle between S3 and the rear
+ * row changes. It acts on a measurement, so it is damping, not a preview of
+ * the path. Off until logged runs (USB 's', Steer_Log()) show it lowers
+ * the tracking error against 0. */
+#define STEER_HDAMP          0
+#define STEER_HDAMP_K        4.0f    /* steer % per rad/s */
+#define STEER_HDAMP_LIM      6       /* steer % */
+
+#if !STEER_INTERP
+#undef  STEER_HDAMP
+#define STEER_HDAMP          0       /* needs the S3 heading */
+#endif
+
+#if STEER_HDAMP
+static steer_damp_t s_hd = { .k_rate_q8 = STEER_GAIN_Q8(STEER_HDAMP_K), .u_lim = STEER_HDAMP_LIM };
+#endif
+
+#if STEER_SCHEDULE
+static const steer_gains_t STEER_GAINS[] = {
+    /* v_mm_s  kp                    ki                   u_max */
+    {   100,  STEER_GAIN_Q8(18.0f), STEER_GAIN_Q8(2.0f),  11 },
+    {   200,  STEER_GAIN_Q8(18.0f), STEER_GAIN_Q8(2.0f),  11 },
+    {   300,  STEER_GAIN_Q8(16.0f), STEER_GAIN_Q8(1.8f),  14 },
+    {   450,  STEER_GAIN_Q8(13.0f), STEER_GAIN_Q8(1.4f),  17 },
+    {   600,  STEER_GAIN_Q8(11.0f), STEER_GAIN_Q8(1.0f),  20 },
+};
+#define STEER_GAINS_N    ((uint8_t)(sizeof(STEER_GAINS) / sizeof(STEER_GAINS[0])))
+#endif
+
+#if STEER_PROFILE
+volatile uint32_t g_prof_cyc_float = 0u;
+volatile uint32_t g_prof_cyc_fixed = 0u;
+volatile uint32_t g_prof_cyc_fixed_max = 0u;
+volatile int32_t  g_prof_max_diff  = 0;
+#endif
+
+/* ================= Autotuned gains ================= */
+/* AUTOTUNE_MODE 1 turns a run into a relay experiment: put the robot on a
+ * long straight (room for AUTOTUNE_SKIP + AUTOTUNE_CYCLES oscillations), it
+ * swings about the line, computes Ziegler-Nichols PI gains (autotune.c),
+ * stores them in EEPROM, stops and reports them over USB ('T' block,
+ * repeated every second). Normal runs load the stored gains:
+ * they replace KP / KI, and with STEER_SCHEDULE scale the whole table by
+ * tuned / table gain at the speed the tune ran at. */
+#define AUTOTUNE_MODE          0
+#define AUTOTUNE_RELAY_H       8                         /* steer % */
+#define AUTOTUNE_EPS_Q15      (STEER_Q15_ONE / 20)       /* relay hysteresis, 0.05 */
+#define STEER_GAINS_FROM_NVM   1
+
+typedef struct {
+    int32_t kp_q8;
+    int32_t ki_q8;
+    int16_t v_mm_s;            /* forward speed during the tune */
+} steer_nvm_t;
+
+#if STEER_SCHEDULE
+static int32_t s_kp_scale_q8 = 256;
+static int32_t s_ki_scale_q8 = 256;
+#endif
+
+#if AUTOTUNE_MODE
+/* Error the steering PI sees, Q15; 0 = no line */
+static uint8_t steer_error(uint16_t V3_pp, uint16_t V4_pp, uint16_t V5_pp, uint16_t V6_pp, int32_t* e_q15)
+{
+#if STEER_INTERP
+    steer_line_t ln;
+    Steer_EstimateLine(Sensor_Normalize(2, V3_pp), Sensor_Normalize(3, V4_pp),
+                       Sensor_Normalize(4, V5_pp), Sensor_Normalize(5, V6_pp), &ln);
+    *e_q15 = Steer_LineErrorQ15(&ln);
+    return ln.valid;
+#else
+    (void)V3_pp;
+    return Steer_PositionQ15(Sensor_Normalize(3, V4_pp), Sensor_Normalize(4, V5_pp),
+                             Sensor_Normalize(5, V6_pp), e_q15);
+#endif
+}
+#endif
+
+/* Stored gains -> st (no schedule) or the schedule scale factors */
+static void steer_load_tuned(steer_t* st)
+{
+#if STEER_GAINS_FROM_NVM
+    steer_nvm_t g;
+    if (!NVM_Read(NVM_ROW_STEER, &g, sizeof(g))) return;
+    if (g.kp_q8 <= 0 || g.kp_q8 > STEER_GAIN_MAX_Q8 ||
+        g.ki_q8 < 0  || g.ki_q8 > STEER_GAIN_MAX_Q8) return;   /* keep KP / KI */
+#if STEER_SCHEDULE
+    steer_t base = *st;
+    Steer_Schedule(&base, STEER_GAINS, STEER_GAINS_N, g.v_mm_s);
+    if (base.kp_q8 > 0) s_kp_scale_q8 = (g.kp_q8 * 256) / base.kp_q8;
+    if (base.ki_q8 > 0) s_ki_scale_q8 = (g.ki_q8 * 256) / base.ki_q8;
+#else
+    st->kp_q8 = g.kp_q8;
+    st->ki_q8 = g.ki_q8;
+#endif
+#else
+    (void)st;
+#endif
+}
+
+static inline int steer_fixed(steer_t* st, uint16_t V3_pp, uint16_t V4_pp, uint16_t V5_pp, uint16_t V6_pp)
+{
+#if STEER_SCHEDULE
+    int32_t v_fwd = (Wheel_SpeedMmS(WHEEL_LEFT) + Wheel_SpeedMmS(WHEEL_RIGHT)) / 2;
+    Steer_Schedule(st, STEER_GAINS, STEER_GAINS_N, v_fwd);
+    st->kp_q8 = (st->kp_q8 * s_kp_scale_q8) / 256;
+    st->ki_q8 = (st->ki_q8 * s_ki_scale_q8) / 256;
+#endif
+#if STEER_HDAMP
+    steer_line_t ln;
+    Steer_EstimateLine(Sensor_Normalize(2, V3_pp), Sensor_Normalize(3, V4_pp),
+                       Sensor_Normalize(4, V5_pp), Sensor_Normalize(5, V6_pp), &ln);
+    int u = Steer_PI(st, ln.valid, Steer_LineErrorQ15(&ln));
+    u += Steer_HeadingDamping(&s_hd, &ln, st->dt_ms);
+    if (u >  st->u_max) u =  st->u_max;
+    if (u < -st->u_max) u = -st->u_max;
+    return u;
+#elif STEER_INTERP
+    return Steer_StepLine(st, Sensor_Normalize(2, V3_pp), Sensor_Normalize(3, V4_pp),
+                          Sensor_Normalize(4, V5_pp), Sensor_Normalize(5, V6_pp));
+#else
+    (void)V3_pp;
+    return Steer_Step(st, Sensor_Normalize(3, V4_pp), Sensor_Normalize(4, V5_pp), Sensor_Normalize(5, V6_pp));
+#endif
+}
+
+static int steer_step(pi_t* pi, steer_t* st, uint16_t V3_pp, uint16_t V4_pp, uint16_t V5_pp, uint16_t V6_pp)
+{
+#if STEER_PROFILE
+    uint32_t t0 = DWT->CYCCNT;
+    int u_f = pi_step(pi, V3_pp, V4_pp, V5_pp, V6_pp);
+    uint32_t t1 = DWT->CYCCNT;
+    int u_q = steer_fixed(st, V3_pp, V4_pp, V5_pp, V6_pp);
+    uint32_t t2 = DWT->CYCCNT;
+
+    g_prof_cyc_float = t1 - t0;
+    g_prof_cyc_fixed = t2 - t1;
+    if (g_prof_cyc_fixed > g_prof_cyc_fixed_max) g_prof_cyc_fixed_max = g_prof_cyc_fixed;
+    int32_t d = (int32_t)u_q - (int32_t)u_f;
+    if (d < 0) d = -d;
+    if (d > g_prof_max_diff) g_prof_max_diff = d;
+    return STEER_FIXED ? u_q : u_f;
+#elif STEER_FIXED
+    (void)pi; (void)pi_step;   /* float reference, only run with STEER_PROFILE */
+    return steer_fixed(st, V3_pp, V4_pp, V5_pp, V6_pp);
+#else
+    (void)st;
+    return pi_step(pi, V3_pp, V4_pp, V5_pp, V6_pp);
+#endif
+}
+
+/* ================= Turn target learning ================= */
+/* After each turn the line angle is measured once and handed to
+ * Directions_Learn(): the S3 heading at the first sample that has one, else
+ * the drift of the rear-row offset over TURN_LEARN_MM of odometry. The
+ * targets live in EEPROM (NVM_ROW_TURNS) and are saved when the run ends.
+ * 0 = fixed TICKS_90_* targets. */
+#define TURN_LEARN           1
+#define TURN_LEARN_MM       40
+#define TURN_LEARN_MAX_MM  120      /* give up if the line is not seen by then */
+
+#if TURN_LEARN
+static uint8_t s_learn_active = 0;
+static uint8_t s_learn_have_x0 = 0;
+static int32_t s_learn_x0_q8 = 0, s_learn_s0 = 0, s_learn_start = 0;
+
+static void turn_learn_start(void)
+{
+    s_learn_active = 1u;
+    s_learn_have_x0 = 0u;
+    s_learn_start = odo_now_mm();
+}
+
+static void turn_learn_update(uint16_t V3_pp, uint16_t V4_pp, uint16_t V5_pp, uint16_t V6_pp)
+{
+    if (!s_learn_active) return;
+    int32_t s = odo_now_mm();
+    if (s - s_learn_start > TURN_LEARN_MAX_MM) {
+        s_learn_active = 0u;
+        return;
+    }
+
+    steer_line_t ln;
+    Steer_EstimateLine(Sensor_Normalize(2, V3_pp), Sensor_Normalize(3, V4_pp),
+                       Sensor_Normalize(4, V5_pp), Sensor_Normalize(5, V6_pp), &ln);
+    if (ln.heading_valid) {
+        Directions_Learn(ln.heading_mrad);
+        s_learn_active = 0u;
+    } else if (ln.valid && !s_learn_have_x0) {
+        s_learn_x0_q8 = ln.x_q8;
+        s_learn_s0 = s;
+        s_learn_have_x0 = 1u;
+    } else if (ln.valid && s - s_learn_s0 >= TURN_LEARN_MM) {
+        Directions_Learn((int16_t)(((ln.x_q8 - s_learn_x0_q8) * 1000 / 256) / (s - s_learn_s0)));
+        s_learn_active = 0u;
+    }
+}
+
+/* Learned targets record: Directions_GetLearned() layout */
+static void turn_targets_load(void)
+{
+    uint8_t t[DIR_LEARN_N];
+    if (NVM_Read(NVM_ROW_TURNS, t, sizeof(t))) Directions_SetLearned(t);
+}
+
+/* Once, when the run is over, and only if anything was learned */
+static void turn_targets_save(void)
+{
+    static uint8_t saved = 0u;
+    uint8_t t[DIR_LEARN_N];
+    if (saved) return;
+    saved = 1u;
+    if (Directions_GetLearned(t) > 0u) (void)NVM_Write(NVM_ROW_TURNS, t, sizeof(t));
+}
+#endif
+
+/* ================= Line-loss recovery ================= */
+/* After LOSS_TIMEOUT_T without a line the robot stops holding its last steer
+ * and searches (recover.c); durations are in Recover_Log() and over USB ('r').
+ * A search that fails stops the run. 0 = hold and decay only. */
+#define LOSS_RECOVERY    1
+
+#if LOSS_RECOVERY
+static uint8_t steer_line_lost(const pi_t* pi, const steer_t* st)
+{
+#if STEER_FIXED
+    (void)pi;
+    return (st->t_loss_ms >= st->loss_timeout_ms) ? 1u : 0u;
+#else
+    (void)st;
+    return (pi->t_loss >= LOSS_TIMEOUT_T) ? 1u : 0u;
+#endif
+}
+
+/* Side of the last held correction: + steer turns left, towards a line on the left */
+static uint8_t steer_last_side(const pi_t* pi, const steer_t* st)
+{
+#if STEER_FIXED
+    (void)pi;
+    return (st->u_q15 >= 0) ? 1u : 2u;
+#else
+    (void)st;
+    return (pi->u >= 0.0f) ? 1u : 2u;
+#endif
+}
+
+/* Runs the search once the line is lost. 1 = the search owns the motors this
+ * loop (skip tracking); on success the loops restart clean. */
+static uint8_t recovery_update(pi_t* pi, steer_t* st)
+{
+    if (!Recover_Active()) {
+        if (!steer_line_lost(pi, st)) return 0u;
+        Recover_Start(steer_last_side(pi, st));
+#if TURN_LEARN
+        s_learn_active = 0u;   /* the search turns the robot, nothing to learn */
+#endif
+    }
+
+    uint8_t r = Recover_Step(sen3_on_line | sen4_on_line | sen5_on_line | sen6_on_line);
+    if (r == RECOVER_SEARCHING) return 1u;
+    if (r == RECOVER_FAILED) {
+        set_motors_symmetric(0);
+        g_stop_now = 1u;
+        return 1u;
+    }
+    pi->i = 0.0f; pi->u = 0.0f; pi->t_loss = 0.0f;
+    Steer_Reset(st);
+    Wheel_Reset();
+#if STEER_HDAMP
+    Steer_HeadingDampingReset(&s_hd);
+#endif
+    return 0u;
+}
+#endif
+
+/* Straight-line drive: outer steering loop output -> wheels */
+static void drive_straight(int center_duty, int steer)
+{
+#if SPEED_LOOP
+    (void)center_duty;
+    int32_t dv = (int32_t)steer * VMAX_CONST_MM_S / 100;
+    Wheel_Drive(V_CRUISE_MM_S - dv, V_CRUISE_MM_S + dv);
+#else
+    set_motors_with_trim_and_steer(center_duty, steer);
+#endif
+}
+
+#if AUTOTUNE_MODE
+/* Relay experiment on a straight; gains saved to EEPROM, then reported until power-off */
+static void autotune_run(int center_duty)
+{
+    autotune_result_t res = { 0 };
+    uint8_t r;
+    int32_t v_sum = 0, v_n = 0;
+
+    Autotune_Start(AUTOTUNE_RELAY_H, AUTOTUNE_EPS_Q15, LOOP_DT_MS);
+    Wheel_Reset();
+    do {
+        uint16_t V3_pp=0, V4_pp=0, V5_pp=0, V6_pp=0;
+        light_sensors_update_and_maybe_request_turn(&V3_pp, &V4_pp, &V5_pp, &V6_pp);
+        g_direction = 0u;   /* no junction handling here, keep the encoder task running */
+
+        int32_t e = 0;
+        int steer = 0;
+        uint8_t valid = steer_error(V3_pp, V4_pp, V5_pp, V6_pp, &e);
+        r = Autotune_Step(valid, e, &steer);
+        if (r == AUTOTUNE_RUNNING) {
+            drive_straight(center_duty, steer);
+            v_sum += (Wheel_SpeedMmS(WHEEL_LEFT) + Wheel_SpeedMmS(WHEEL_RIGHT)) / 2;
+            v_n++;
+            CyDelay(LOOP_DT_MS);
+        }
+    } while (r == AUTOTUNE_RUNNING);
+
+    set_motors_symmetric(0);
+    motor_enable(1u, 1u);
+
+    uint8_t saved = 0u;
+    if (r == AUTOTUNE_DONE) {
+        Autotune_Result(&res);
+        steer_nvm_t g = { .kp_q8 = res.kp_q8, .ki_q8 = res.ki_q8,
+                          .v_mm_s = (int16_t)((v_n > 0) ? v_sum / v_n : V_CRUISE_MM_S) };
+        saved = NVM_Write(NVM_ROW_STEER, &g, sizeof(g));
+    }
+
+    uint8_t p[17] = {
+        LO8(LO16(res.kp_q8)), HI8(LO16(res.kp_q8)), LO8(HI16(res.kp_q8)), HI8(HI16(res.kp_q8)),
+        LO8(LO16(res.ki_q8)), HI8(LO16(res.ki_q8)), LO8(HI16(res.ki_q8)), HI8(HI16(res.ki_q8)),
+        LO8(LO16(res.ku_q8)), HI8(LO16(res.ku_q8)), LO8(HI16(res.ku_q8)), HI8(HI16(res.ku_q8)),
+        LO8(res.tu_ms), HI8(res.tu_ms), LO8(res.amp_q15), HI8(res.amp_q15), saved };
+    for (;;) {
+        USBLog_Poll();
+        USBLog_SendBlock('T', p, sizeof(p));
+        CyDelay(1000);
+    }
+}
+#endif
+
 int main(void)
 {
     motor_enable(1u, 1u);
     CyGlobalIntEnable;
 
-    /* ADC for sensors */
-    ADC_Start();
-    CyDelay(10);
+    /* ADC for sensors (background scan DMA in SENSOR_ACQ_DMA mode) */
+    Sensor_Init();
+
+    /* USB link for sensor captures (no-op without USE_USB) */
+    USBLog_Init();
 
     /* Encoders + 5 ms tick (distance only) */
     Clock_QENC_Start();
@@ -233,6 +669,7 @@ int main(void)
     QuadDec_M1_SetCounter(0); QuadDec_M2_SetCounter(0);
     Clock_QD_Start();
     Timer_QD_Start();  // 5 ms period in TopDesign
+    Wheel_Init(MM_PER_COUNT_X1000, QD_SAMPLE_MS, VMAX_CONST_MM_S, LOOP_DT_MS);
     isr_qd_StartEx(isr_qd_Handler);
 
     /* PWM & motor driver */
@@ -247,6 +684,12 @@ int main(void)
     Directions_Init();
     g_direction = 0u;
 
+#if CALIB_AT_STARTUP
+    /* Rock over the line once and set per-sensor thresholds. The LED stays
+     * on if any channel kept the default band ('k' over USB says which) */
+    LED_Write((Calib_Run() == CALIB_MASK_ALL) ? 0u : 1u);
+#endif
+
     /* Feed-forward cruise duty (kept) */
     int center_duty_est = (int)((V_CRUISE_MM_S * 100) / VMAX_CONST_MM_S);
     if (center_duty_est < 0) center_duty_est = 0;
@@ -254,11 +697,26 @@ int main(void)
 
     /* PI state */
     pi_t pi = { .i = 0.0f, .u = 0.0f, .t_loss = 0.0f };
+    steer_t st = {
+        .kp_q8 = STEER_GAIN_Q8(KP), .ki_q8 = STEER_GAIN_Q8(KI),
+        .u_max = STEER_MAX, .i_lim_q15 = (int32_t)(INT_LIM * STEER_Q15_ONE),
+        .dt_ms = LOOP_DT_MS, .loss_timeout_ms = (uint16_t)(LOSS_TIMEOUT_T * 1000.0f)
+    };
+    Steer_Reset(&st);
+    NVM_Init();
+    steer_load_tuned(&st);
+#if TURN_LEARN
+    turn_targets_load();
+#endif
     
     CyDelay(1000);  // So the motors don't jump
     set_motors_with_trim_and_steer(100,-10);
     CyDelay(40);
     set_motors_symmetric(0); 
+
+#if AUTOTUNE_MODE
+    autotune_run(center_duty_est);   /* does not return */
+#endif
     
     
     // Pathfinding array
@@ -343,14 +801,35 @@ const uint8_t CMD_STATES[] = {
 
     for(;;){
         
+        USBLog_Poll();
+
         // This check will make the robot stay stopped
         // once the path is complete.
         if (g_stop_now) {
             set_motors_symmetric(0);
             motor_enable(1u, 1u);
+#if TURN_LEARN
+            turn_targets_save();
+#endif
             continue;
         }
 
+        if (food_stop_ticks > 0u) {
+            set_motors_symmetric(0);
+            if (--food_stop_ticks == 0u) Wheel_Reset();   /* speed loops start clean */
+            CyDelay(LOOP_DT_MS);
+            continue;
+        }
+
+        /* Where S1/S2 actually crossed a line while running straight */
+        sensor_edge_t ev;
+        while (Sensor_PopEdge(&ev)) {
+            if (ev.on_line && ev.channel <= 1u && CMD_STATES[i] == 0u) {
+                s12_edge_mm = odo_mm(ev.dist_mm, ev.qd_m1, ev.qd_m2);
+                s12_edge_valid = 1u;
+            }
+        }
+
         /* Read sensors + maybe request turn */
         uint16_t V3_pp=0, V4_pp=0, V5_pp=0, V6_pp=0;
         light_sensors_update_and_maybe_request_turn(&V3_pp, &V4_pp, &V5_pp, &V6_pp);
@@ -424,39 +903,43 @@ const uint8_t CMD_STATES[] = {
         
         
         
-        /* Straight run with PI steering */        
-        if(turn_cooldown_ticks > 0) {
-            turn_cooldown_ticks--;
-       }
-        
-        
         // PATHFINDING ALGORITHM
         
         if (CMD_STATES[i] == 0) {
             // Go STRAIGHT
-            int steer = pi_step(&pi, V3_pp, V4_pp, V5_pp, V6_pp);
-            set_motors_with_trim_and_steer(center_duty_est, steer);
-
-            // Rising-edge detect on S1/S2
-            uint16_t V1 = Sensor_ComputePeakToPeak(0);
-            uint16_t V2 = Sensor_ComputePeakToPeak(1);
-            sen1_on_line = (V1 > 10 && V1 < 100) ? 1u : 0u;
-            sen2_on_line = (V2 > 10 && V2 < 100) ? 1u : 0u;
-
-            uint8_t s12_now = (sen1_on_line | sen2_on_line);
-            if (s12_now && !s12_prev) {
-                straight_complete = 1;     // tell the indexer to advance
+#if LOSS_RECOVERY
+            if (recovery_update(&pi, &st)) {
+                CyDelay(LOOP_DT_MS);
+                continue;
+            }
+#endif
+            int steer = steer_step(&pi, &st, V3_pp, V4_pp, V5_pp, V6_pp);
+            drive_straight(center_duty_est, steer);
+#if TURN_LEARN
+            turn_learn_update(V3_pp, V4_pp, V5_pp, V6_pp);
+#endif
+
+            // S1/S2 come from the same batched window as S3..S6 (top of the loop)
+            uint8_t line_mask = (uint8_t)(sen1_on_line | (sen2_on_line << 1) | (sen3_on_line << 2) |
+                                          (sen4_on_line << 3) | (sen5_on_line << 4) | (sen6_on_line << 5));
+            junction_t jn;
+            if (Junction_Update(line_mask, odo_now_mm(), &jn)) {
+                /* a dead end only counts where the mission turns around;
+                 * anywhere else it is a lost line for the recovery search */
+                uint8_t next = ((uint8_t)(i + 1) < sizeof(CMD_STATES)) ? CMD_STATES[i + 1] : 0u;
+                if (jn.type != JUNCTION_FALSE && (jn.type != JUNCTION_DEAD_END || next == 3u)) {
+                    straight_complete = 1;     // tell the indexer to advance
+                }
             }
-            s12_prev = s12_now;
 
             
         } else if((CMD_STATES[i] == 1)) {
             // Go LEFT
             
-            g_direction = 1u;
+            g_direction = TURN_REQ_LEFT;
             /* ---------------- Turn handling with arming delay (Option A) ---------------- */
                 /* Arm once on the first detection (edge 0 -> 1/2) */
-                if ((g_direction == 1u || g_direction == 2u) && dir_latched_side == 0){
+                if ((g_direction == TURN_REQ_LEFT || g_direction == TURN_REQ_RIGHT) && dir_latched_side == 0){
                     dir_latched_side = g_direction;          /* remember side */
                     dir_delay_ticks  = DIR_CALL_DELAY_TICKS; /* start countdown */
                     //CyDelay(50);
@@ -467,10 +950,9 @@ const uint8_t CMD_STATES[] = {
                     dir_delay_ticks  = 0;
                 }
 
-                if (g_direction == 1u || g_direction == 2u){
-                    if (dir_delay_ticks > 0){
-                        /* Still delaying: keep doing normal straight PI */
-                        dir_delay_ticks--;
+                if (g_direction == TURN_REQ_LEFT || g_direction == TURN_REQ_RIGHT){
+                    if (dir_call_waiting()){
+                        /* Not at the pivot point yet: keep doing normal straight PI */
                     } else {
                         /* Delay elapsed: perform the maneuver */
                         Directions_Handle(&g_direction);
@@ -478,30 +960,31 @@ const uint8_t CMD_STATES[] = {
                         /* When turn completes, Directions sets g_direction back to 0 */
                         if (g_direction == 0u){
                             pi.i = 0.0f; pi.u = 0.0f; pi.t_loss = 0.0f;  /* clear bias */
+                            Steer_Reset(&st);
+                            if (!DIR_IS_ARC(dir_latched_side)) Wheel_Reset();   /* still rolling after an arc */
+#if STEER_HDAMP
+                            Steer_HeadingDampingReset(&s_hd);
+#endif
                             dir_latched_side = 0;                        /* ready next time */
-                            
-                            
-                            turn_cooldown_ticks = TURN_COOLDOWN_TICKS);
+                            s12_edge_valid = 0u;
                             turn_complete = 1;
+#if TURN_LEARN
+                            turn_learn_start();
+#endif
                         }
                         CyDelay(LOOP_DT_MS);
                         continue;  /* skip the rest this tick */
                     }
                 }
                 /* ---------------- end turn handling with delay ---------------- */
-                /* Straight run with PI steering */
-        
-        if(turn_cooldown_ticks > 0) {
-            turn_cooldown_ticks--;
-        }
                 
             
         } else if((CMD_STATES[i] == 2)) {
             // Go RIGHT
-            g_direction = 2u;
+            g_direction = TURN_REQ_RIGHT;
             /* ---------------- Turn handling with arming delay (Option A) ---------------- */
                 /* Arm once on the first detection (edge 0 -> 1/2) */
-                if ((g_direction == 1u || g_direction == 2u) && dir_latched_side == 0){
+                if ((g_direction == TURN_REQ_LEFT || g_direction == TURN_REQ_RIGHT) && dir_latched_side == 0){
                     dir_latched_side = g_direction;          /* remember side */
                     dir_delay_ticks  = DIR_CALL_DELAY_TICKS; /* start countdown */
                     //CyDelay(50);
@@ -512,10 +995,9 @@ const uint8_t CMD_STATES[] = {
                     dir_delay_ticks  = 0;
                 }
 
-                if (g_direction == 1u || g_direction == 2u){
-                    if (dir_delay_ticks > 0){
-                        /* Still delaying: keep doing normal straight PI */
-                        dir_delay_ticks--;
+                if (g_direction == TURN_REQ_LEFT || g_direction == TURN_REQ_RIGHT){
+                    if (dir_call_waiting()){
+                        /* Not at the pivot point yet: keep doing normal straight PI */
                     } else {
                         /* Delay elapsed: perform the maneuver */
                         Directions_Handle(&g_direction);
@@ -523,22 +1005,23 @@ const uint8_t CMD_STATES[] = {
                         /* When turn completes, Directions sets g_direction back to 0 */
                         if (g_direction == 0u){
                             pi.i = 0.0f; pi.u = 0.0f; pi.t_loss = 0.0f;  /* clear bias */
+                            Steer_Reset(&st);
+                            if (!DIR_IS_ARC(dir_latched_side)) Wheel_Reset();   /* still rolling after an arc */
+#if STEER_HDAMP
+                            Steer_HeadingDampingReset(&s_hd);
+#endif
                             dir_latched_side = 0;                        /* ready next time */
-                            
-                            
-                            turn_cooldown_ticks = TURN_COOLDOWN_TICKS);
+                            s12_edge_valid = 0u;
                             turn_complete = 1;
+#if TURN_LEARN
+                            turn_learn_start();
+#endif
                         }
                         CyDelay(LOOP_DT_MS);
                         continue;  /* skip the rest this tick */
                     }
                 }
                 /* ---------------- end turn handling with delay ---------------- */
-                /* Straight run with PI steering */
-        
-        if(turn_cooldown_ticks > 0) {
-            turn_cooldown_ticks--;
-        }
             
         } else if((CMD_STATES[i] == 3)) {
             // Do U-TURN
@@ -557,9 +1040,8 @@ const uint8_t CMD_STATES[] = {
                 }
 
                 if (g_direction == 1u || g_direction == 2u || g_direction == 3u){
-                    if (dir_delay_ticks > 0){
-                        /* Still delaying: keep doing normal straight PI */
-                        dir_delay_ticks--;
+                    if (dir_call_waiting()){
+                        /* Not at the pivot point yet: keep doing normal straight PI */
                     } else {
                         /* Delay elapsed: perform the maneuver */
                         Directions_Handle(&g_direction);
@@ -567,22 +1049,23 @@ const uint8_t CMD_STATES[] = {
                         /* When turn completes, Directions sets g_direction back to 0 */
                         if (g_direction == 0u){
                             pi.i = 0.0f; pi.u = 0.0f; pi.t_loss = 0.0f;  /* clear bias */
+                            Steer_Reset(&st);
+                            Wheel_Reset();
+#if STEER_HDAMP
+                            Steer_HeadingDampingReset(&s_hd);
+#endif
                             dir_latched_side = 0;                        /* ready next time */
-                            
-                            
-                            turn_cooldown_ticks = TURN_COOLDOWN_TICKS);
+                            s12_edge_valid = 0u;
                             uTurn_complete = 1;
+#if TURN_LEARN
+                            turn_learn_start();
+#endif
                         }
                         CyDelay(LOOP_DT_MS);
                         continue;  /* skip the rest this tick */
                     }
                 }
                 /* ---------------- end turn handling with delay ---------------- */
-                /* Straight run with PI steering */
-        
-        if(turn_cooldown_ticks > 0) {
-            turn_cooldown_ticks--;
-        }
           
             
         } else if((CMD_STATES[i] == 5)) {
@@ -609,8 +1092,14 @@ const uint8_t CMD_STATES[] = {
          // DO NOT 'continue' here
         } else {
          // Target not met: KEEP DRIVING
-         int steer = pi_step(&pi, V3_pp, V4_pp, V5_pp, V6_pp);
-         set_motors_with_trim_and_steer(center_duty_est, steer);
+#if LOSS_RECOVERY
+         if (recovery_update(&pi, &st)) {
+             CyDelay(LOOP_DT_MS);
+             continue;
+         }
+#endif
+         int steer = steer_step(&pi, &st, V3_pp, V4_pp, V5_pp, V6_pp);
+         drive_straight(center_duty_est, steer);
          }
 
         
@@ -623,35 +1112,6 @@ const uint8_t CMD_STATES[] = {
         
         }
         
-        // food
-        if (i == 13 || i == 23 || i == 31 || i == 44) {
-            CyDelay(2000);
-        } 
-        
-        
-        
-        if (i== 4 ) {
-            //TURN_COOLDOWN_MS = 4000;
-            turn_cooldown_ticks = TURN_COOLDOWN_TICKS);
-        } 
-        if ( i== 10) {
-            //TURN_COOLDOWN_MS = 2000;
-            turn_cooldown_ticks = TURN_COOLDOWN_TICKS);
-        }
-        if ( i== 35) {
-            //TURN_COOLDOWN_MS = 5000;
-            turn_cooldown_ticks = TURN_COOLDOWN_TICKS);
-        }
-        if ( i== 38) {
-            //TURN_COOLDOWN_MS = 500;
-            turn_cooldown_ticks = TURN_COOLDOWN_TICKS);
-        }
-        if ( i== 46) {
-            //TURN_COOLDOWN_MS = 1000;
-            turn_cooldown_ticks = TURN_COOLDOWN_TICKS);
-        }
-        
-        
         if (straight_complete == 1u || turn_complete == 1u || uTurn_complete == 1u || fruit_complete == 1u) {
             
             // Check if we are at the end of the array
@@ -661,6 +1121,7 @@ const uint8_t CMD_STATES[] = {
          } else {
          // Not done. Advance to the next state.
          i += 1;
+         if (IS_FOOD_INDEX(i)) food_stop_ticks = FOOD_STOP_TICKS;
         }
             
             straight_complete = 0;
@@ -669,6 +1130,8 @@ const uint8_t CMD_STATES[] = {
             fruit_complete = 0;
             
             target_dist = 0;
+            seg_start_mm = odo_now_mm();
+            Junction_Reset(seg_start_mm);
         }
         
 
@@ -0,0 +1,51 @@
+#include <project.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nvm.h"
+
+/* ===================== Constants ===================== */
+#define NVM_MAGIC       0x5Au
+
+static uint8_t sum8(const uint8_t* p, uint8_t n)
+{
+    uint8_t s = 0;
+    while (n--) s += *p++;
+    return s;
+}
+
+void NVM_Init(void)
+{
+    CyEEPROM_Start();
+}
+
+uint8_t NVM_Read(uint8_t row, void* data, uint8_t len)
+{
+    if (row >= CY_EEPROM_NUMBER_ROWS || len > NVM_MAX_PAYLOAD) return 0u;
+
+    uint8_t buf[CY_EEPROM_SIZEOF_ROW];
+    const reg8* ee = (const reg8*)(CY_EEPROM_BASE + (uint32)row * CY_EEPROM_SIZEOF_ROW);
+    for (uint8_t k = 0; k < CY_EEPROM_SIZEOF_ROW; k++) buf[k] = CY_GET_REG8(ee + k);
+
+    if (buf[0] != NVM_MAGIC || buf[1] != len) return 0u;
+    if (buf[CY_EEPROM_SIZEOF_ROW - 1u] != sum8(buf, CY_EEPROM_SIZEOF_ROW - 1u)) return 0u;
+
+    memcpy(data, &buf[2], len);
+    return 1u;
+}
+
+uint8_t NVM_Write(uint8_t row, const void* data, uint8_t len)
+{
+    if (row >= CY_EEPROM_NUMBER_ROWS || len > NVM_MAX_PAYLOAD) return 0u;
+
+    uint8_t buf[CY_EEPROM_SIZEOF_ROW];
+    memset(buf, 0, sizeof(buf));
+    buf[0] = NVM_MAGIC;
+    buf[1] = len;
+    memcpy(&buf[2], data, len);
+    buf[CY_EEPROM_SIZEOF_ROW - 1u] = sum8(buf, CY_EEPROM_SIZEOF_ROW - 1u);
+
+    /* the SPC needs the die temperature before programming */
+    if (CySetTemp() != CYRET_SUCCESS) return 0u;
+    return (CyWriteRowData(CY_SPC_FIRST_EE_ARRAYID, row, buf) == CYRET_SUCCESS) ? 1u : 0u;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <stdint.h>
+
+/* Settings kept in the on-chip EEPROM (CyFlash API, 16-byte rows).
+ * One record per row: magic, payload length, payload, sum8, so a blank or
+ * half-written row reads as "nothing stored". */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Row of each record */
+#define NVM_ROW_STEER          0u      /* autotuned steering gains */
+#define NVM_ROW_TURNS          1u      /* learned turn targets (directions.c) */
+
+#define NVM_MAX_PAYLOAD       13u      /* row size - magic - length - sum */
+
+/* Call once before any read or write */
+void NVM_Init(void);
+
+/* Copy the record in row into data (len bytes); 0 if the row holds no valid
+ * record of exactly that length */
+uint8_t NVM_Read(uint8_t row, void* data, uint8_t len);
+
+/* Program one record; 1 on success. Blocks for the row write (~ms). */
+uint8_t NVM_Write(uint8_t row, const void* data, uint8_t len);
+
+#ifdef __cplusplus
+}
+#endif
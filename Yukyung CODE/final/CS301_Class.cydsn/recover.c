@@ -0,0 +1,89 @@
+#include <project.h>
+#include <stdint.h>
+
+#include "recover.h"
+#include "directions.h"  // Directions_Pivot()
+#include "wheel.h"       // Wheel_AbsTicks()
+
+#define CYC_PER_MS     (BCLK__BUS_CLK__HZ / 1000u)
+
+/* ===================== State ===================== */
+static uint8_t  s_active = 0;
+static uint8_t  s_side = 1;          /* pivot direction of the current leg */
+static uint16_t s_amp = 0;           /* swing of the current leg, ticks from centre */
+static uint32_t s_leg_start = 0;     /* Wheel_AbsTicks() at the start of the leg */
+static uint32_t s_leg_len = 0;       /* ticks this leg has to cover */
+static uint8_t  s_full_legs = 0;     /* legs finished at RECOVER_AMP_MAX */
+static uint32_t s_t0 = 0;            /* DWT->CYCCNT at Recover_Start() */
+static recover_log_t s_log;
+
+static void finish(uint8_t ok)
+{
+    Directions_Pivot(0u);
+    s_active = 0u;
+
+    uint32_t ms = (DWT->CYCCNT - s_t0) / CYC_PER_MS;
+    if (ms > 0xFFFFu) ms = 0xFFFFu;
+    s_log.last_ms = (uint16_t)ms;
+    s_log.total_ms += ms;
+    if (ok) {
+        if (s_log.last_ms > s_log.max_ms) s_log.max_ms = s_log.last_ms;
+    } else {
+        s_log.failed++;
+    }
+}
+
+void Recover_Start(uint8_t side)
+{
+    s_side = (side == 2u) ? 2u : 1u;
+    s_amp = RECOVER_AMP0;
+    s_leg_start = Wheel_AbsTicks();
+    s_leg_len = RECOVER_AMP0;
+    s_full_legs = 0u;
+    s_t0 = DWT->CYCCNT;
+    s_active = 1u;
+    s_log.count++;
+    Directions_Pivot(s_side);
+}
+
+uint8_t Recover_Step(uint8_t line_seen)
+{
+    if (!s_active) return RECOVER_FAILED;
+
+    if (line_seen) {
+        finish(1u);
+        return RECOVER_FOUND;
+    }
+    if ((DWT->CYCCNT - s_t0) / CYC_PER_MS >= RECOVER_TIMEOUT_MS) {
+        finish(0u);
+        return RECOVER_FAILED;
+    }
+
+    if (Wheel_AbsTicks() - s_leg_start >= s_leg_len) {
+        /* both sides searched at full swing: the line is not within reach */
+        if (s_amp >= RECOVER_AMP_MAX && ++s_full_legs >= 2u) {
+            finish(0u);
+            return RECOVER_FAILED;
+        }
+
+        /* swing back through the centre and twice as far out the other way */
+        uint16_t next = (uint16_t)(s_amp * 2u);
+        if (next > RECOVER_AMP_MAX) next = RECOVER_AMP_MAX;
+        s_leg_len = (uint32_t)s_amp + next;
+        s_amp = next;
+        s_side = (s_side == 1u) ? 2u : 1u;
+        s_leg_start = Wheel_AbsTicks();
+    }
+    Directions_Pivot(s_side);
+    return RECOVER_SEARCHING;
+}
+
+uint8_t Recover_Active(void)
+{
+    return s_active;
+}
+
+const recover_log_t* Recover_Log(void)
+{
+    return &s_log;
+}
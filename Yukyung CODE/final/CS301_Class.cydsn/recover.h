@@ -0,0 +1,42 @@
+#pragma once
+#include <stdint.h>
+
+/* Line-loss recovery. Once the steering loop has had no line for its loss
+ * timeout, pivot in place to find it again, bounded by the encoders:
+ *  1. back towards the side the line was last seen on
+ *  2. a sweep that doubles its swing on every pass, up to RECOVER_AMP_MAX
+ * and hand back to tracking the moment a steering sensor sees the line.
+ * Directions_Pivot() drives, Wheel_AbsTicks() measures (~1 tick per degree). */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RECOVER_AMP0           15u     /* first swing, ticks */
+#define RECOVER_AMP_MAX        90u     /* widest swing each side */
+#define RECOVER_TIMEOUT_MS   3000u     /* give up after this long in any case */
+
+#define RECOVER_SEARCHING      0u
+#define RECOVER_FOUND          1u
+#define RECOVER_FAILED         2u
+
+/* How long recoveries take: judge whether a speed setting is safe */
+typedef struct {
+    uint16_t count;            /* recoveries started */
+    uint16_t failed;           /* of those, gave up */
+    uint16_t last_ms;          /* duration of the last one */
+    uint16_t max_ms;           /* longest found so far */
+    uint32_t total_ms;
+} recover_log_t;
+
+/* side: 1 = line last seen to the left, 2 = to the right */
+void Recover_Start(uint8_t side);
+
+/* Call every loop while active; line_seen = any of S3..S6 on the line */
+uint8_t Recover_Step(uint8_t line_seen);
+
+uint8_t Recover_Active(void);
+const recover_log_t* Recover_Log(void);
+
+#ifdef __cplusplus
+}
+#endif
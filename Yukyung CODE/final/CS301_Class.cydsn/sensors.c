@@ -4,6 +4,666 @@
 #include <stdlib.h>
 #include <stdio.h>
 
+// On-line band per channel and 1/(hi - lo) in Q16 for Sensor_Normalize()
+static uint16_t s_cal_lo[SENSOR_NUM_CH] = { S_MINC_COUNTS, S_MINC_COUNTS, S_MINC_COUNTS,
+                                            S_MINC_COUNTS, S_MINC_COUNTS, S_MINC_COUNTS };
+static uint16_t s_cal_hi[SENSOR_NUM_CH] = { S_MAXC_COUNTS, S_MAXC_COUNTS, S_MAXC_COUNTS,
+                                            S_MAXC_COUNTS, S_MAXC_COUNTS, S_MAXC_COUNTS };
+static uint32_t s_cal_k[SENSOR_NUM_CH]  = {
+    65536u / (S_MAXC_COUNTS - S_MINC_COUNTS), 65536u / (S_MAXC_COUNTS - S_MINC_COUNTS),
+    65536u / (S_MAXC_COUNTS - S_MINC_COUNTS), 65536u / (S_MAXC_COUNTS - S_MINC_COUNTS),
+    65536u / (S_MAXC_COUNTS - S_MINC_COUNTS), 65536u / (S_MAXC_COUNTS - S_MINC_COUNTS) };
+
+static void cal_default(uint8_t channel)
+{
+    s_cal_lo[channel] = S_MINC_COUNTS;
+    s_cal_hi[channel] = S_MAXC_COUNTS;
+    s_cal_k[channel]  = 65536u / (S_MAXC_COUNTS - S_MINC_COUNTS);
+}
+
+uint8_t Sensor_SetCalibration(uint8_t channel, uint16_t on_pp, uint16_t off_pp)
+{
+    if (channel >= SENSOR_NUM_CH) return 0;
+
+    // The sweep must have crossed the tape: the lowest level inside the default
+    // line band and the floor clearly above it. Floor texture or lamp drift
+    // alone would otherwise pass the span test and move the floor into the band.
+    if (on_pp <= S_MINC_COUNTS || on_pp >= S_MAXC_COUNTS ||
+        off_pp < on_pp + SENSOR_CAL_MIN_SPAN ||
+        off_pp < SENSOR_CAL_FLOOR_RATIO * on_pp) {
+        cal_default(channel);
+        return 0;
+    }
+
+    // upper edge halfway to the floor level, lower edge below the line level
+    // (never above the old fixed floor, so a weak but valid signal still counts)
+    uint16_t hi = (uint16_t)(on_pp + (off_pp - on_pp) / 2u);
+    uint16_t lo = on_pp / 2u;
+    if (lo > S_MINC_COUNTS) lo = S_MINC_COUNTS;
+
+    s_cal_lo[channel] = lo;
+    s_cal_hi[channel] = hi;
+    s_cal_k[channel]  = 65536u / (uint32_t)(hi - lo);
+    return 1;
+}
+
+uint8_t Sensor_IsOnLine(uint8_t channel, uint16_t pp)
+{
+    if (channel >= SENSOR_NUM_CH) return 0;
+    return (pp > s_cal_lo[channel] && pp < s_cal_hi[channel]) ? 1u : 0u;
+}
+
+uint16_t Sensor_Normalize(uint8_t channel, uint16_t pp)
+{
+    if (channel >= SENSOR_NUM_CH) return 0;
+    if (pp <= s_cal_lo[channel]) return 0;
+    if (pp >= s_cal_hi[channel]) return SENSOR_NORM_ONE;
+    // (pp - lo) * k < 2^16 inside the band, so scale to SENSOR_NORM_ONE (2^10) by >> 6
+    return (uint16_t)(((uint32_t)(pp - s_cal_lo[channel]) * s_cal_k[channel]) >> 6);
+}
+
+// Line edge events: one entry per debounced on/off transition of a channel
+static sensor_edge_t    s_edge_q[SENSOR_EDGE_QLEN];
+static volatile uint8_t s_edge_wr = 0, s_edge_rd = 0;
+static uint8_t          s_line_state = 0;   // bit per channel, 1 = on the line
+
+extern volatile int32_t g_dist_mm;          // main.c, odometer at the last 5 ms tick
+
+// Called with every new p-p value. A channel leaves the line only once it is
+// SENSOR_EDGE_HYST past the upper edge, so a value sitting on it does not chatter.
+// The value lags the sensor by the estimator window, which is a fixed distance
+// at cruise speed and is absorbed by the caller's offset.
+static void edge_check(uint8_t ch, uint16_t pp)
+{
+    uint8_t bit = (uint8_t)(1u << ch);
+    uint8_t was = (s_line_state & bit) ? 1u : 0u;
+    uint8_t now = was ? ((pp > s_cal_lo[ch] && pp < s_cal_hi[ch] + SENSOR_EDGE_HYST) ? 1u : 0u)
+                      : Sensor_IsOnLine(ch, pp);
+    if (now == was) return;
+    s_line_state ^= bit;
+
+    uint8_t next = (uint8_t)((s_edge_wr + 1u) & (SENSOR_EDGE_QLEN - 1u));
+    if (next == s_edge_rd) return;   // queue full, the reader is too far behind to care
+
+    sensor_edge_t* ev = &s_edge_q[s_edge_wr];
+    uint8 is = CyEnterCriticalSection();
+    ev->cycles  = DWT->CYCCNT;
+    ev->qd_m1   = QuadDec_M1_GetCounter();
+    ev->qd_m2   = QuadDec_M2_GetCounter();
+    ev->dist_mm = g_dist_mm;
+    CyExitCriticalSection(is);
+    ev->channel = ch;
+    ev->on_line = now;
+    s_edge_wr = next;
+}
+
+uint8_t Sensor_PopEdge(sensor_edge_t* ev)
+{
+    if (ev == NULL || s_edge_rd == s_edge_wr) return 0;
+    uint8 is = CyEnterCriticalSection();
+    *ev = s_edge_q[s_edge_rd];
+    s_edge_rd = (uint8_t)((s_edge_rd + 1u) & (SENSOR_EDGE_QLEN - 1u));
+    CyExitCriticalSection(is);
+    return 1;
+}
+
+uint8_t Sensor_LineState(void)
+{
+    return s_line_state;
+}
+
+// Raw capture buffer, filled by the ISR (DMA) or the polling loop
+static int16_t          s_cap[SENSOR_CAP_SCANS][SENSOR_NUM_CH];
+static uint16_t         s_cap_n[SENSOR_NUM_CH];
+static volatile uint8_t s_cap_armed = 0;      // bit per channel still filling
+static volatile uint8_t s_cap_ready = 0;
+static uint8_t          s_cap_chans = 0;      // channels taking part
+
+void Sensor_CaptureArm(void)
+{
+    s_cap_ready = 0u;
+    for (uint8_t ch = 0; ch < SENSOR_NUM_CH; ch++) s_cap_n[ch] = 0;
+    s_cap_chans = (uint8_t)((1u << SENSOR_NUM_CH) - 1u);
+    s_cap_armed = s_cap_chans;
+    if (s_cap_armed == 0u) s_cap_ready = 1u;
+}
+
+uint8_t Sensor_CaptureReady(void)
+{
+    return s_cap_ready;
+}
+
+void Sensor_CaptureFinish(void)
+{
+    uint8 is = CyEnterCriticalSection();
+    s_cap_armed = 0u;
+    s_cap_ready = 1u;
+    CyExitCriticalSection(is);
+}
+
+const int16_t* Sensor_CaptureBuffer(uint16_t* n_scans, uint8_t* chan_mask)
+{
+    uint16_t n = SENSOR_CAP_SCANS;
+    for (uint8_t ch = 0; ch < SENSOR_NUM_CH; ch++) {
+        if ((s_cap_chans & (1u << ch)) && s_cap_n[ch] < n) n = s_cap_n[ch];
+    }
+    if (n_scans)   *n_scans   = s_cap_ready ? n : 0u;
+    if (chan_mask) *chan_mask = s_cap_chans;
+    return &s_cap[0][0];
+}
+
+static void capture_done(uint8_t ch)
+{
+    s_cap_armed &= (uint8_t)~(1u << ch);
+    if (s_cap_armed == 0u) s_cap_ready = 1u;
+}
+
+// One sample of one channel; the channel is done when its column is full
+// or (polling) its window ended first
+static inline void capture_sample(uint8_t ch, int16_t v)
+{
+    uint8_t bit = (uint8_t)(1u << ch);
+    if (!(s_cap_armed & bit)) return;
+    s_cap[s_cap_n[ch]][ch] = v;
+    if (++s_cap_n[ch] >= SENSOR_CAP_SCANS) capture_done(ch);
+}
+
+// Window statistics behind Sensor_GetConfidence(). DMA mode keeps them over
+// tumbling windows of SENSOR_WINDOW_SCANS scans whatever the estimator; the
+// polling paths over each channel's own window (up to SENSOR_POLL_SAMPLES,
+// 1700 without the timer). The sum of squares is 64-bit: 12-bit samples
+// overflow uint32 after 256 of them.
+static int32_t           s_st_sum[SENSOR_NUM_CH];
+static uint64_t          s_st_sq[SENSOR_NUM_CH];
+static int16_t           s_st_lo[SENSOR_NUM_CH] = { 4095, 4095, 4095, 4095, 4095, 4095 };
+static int16_t           s_st_hi[SENSOR_NUM_CH];
+static uint16_t          s_st_clip[SENSOR_NUM_CH];
+static uint16_t          s_st_n[SENSOR_NUM_CH];
+static volatile uint32_t s_cf_var[SENSOR_NUM_CH];
+static volatile uint16_t s_cf_clip[SENSOR_NUM_CH];
+static volatile uint16_t s_cf_n[SENSOR_NUM_CH];
+static volatile uint16_t s_cf_pp[SENSOR_NUM_CH];   // p-p of the same window
+
+static inline void stats_add(uint8_t ch, int16_t v)
+{
+    s_st_sum[ch] += v;
+    s_st_sq[ch]  += (uint32_t)((int32_t)v * v);
+    if (v < s_st_lo[ch]) s_st_lo[ch] = v;
+    if (v > s_st_hi[ch]) s_st_hi[ch] = v;
+    if (v <= 0 || v >= 4095) s_st_clip[ch]++;
+    s_st_n[ch]++;
+}
+
+static void stats_publish(uint8_t ch)
+{
+    uint16_t n = s_st_n[ch];
+    if (n) {
+        // n * sum(x^2) - sum(x)^2 >= 0, divided by n^2
+        int64_t sum = s_st_sum[ch];
+        s_cf_var[ch] = (uint32_t)(((int64_t)s_st_sq[ch] * n - sum * sum) / ((int64_t)n * n));
+        s_cf_pp[ch]  = (uint16_t)(s_st_hi[ch] - s_st_lo[ch]);
+    } else {
+        s_cf_var[ch] = 0;
+        s_cf_pp[ch]  = 0;
+    }
+    s_cf_clip[ch] = s_st_clip[ch];
+    s_cf_n[ch]    = n;
+    s_st_sum[ch] = 0; s_st_sq[ch] = 0; s_st_clip[ch] = 0; s_st_n[ch] = 0;
+    s_st_lo[ch] = 4095; s_st_hi[ch] = 0;
+}
+
+#if SENSOR_PROFILE
+// Per-scan work of whichever estimator runs, summed over SENSOR_WINDOW_SCANS
+static sensor_prof_t s_prof;
+static uint32_t      s_prof_acc = 0, s_prof_max = 0;
+static uint16_t      s_prof_n = 0;
+
+static inline void prof_scan(uint32_t cyc)
+{
+    s_prof_acc += cyc;
+    if (cyc > s_prof_max) s_prof_max = cyc;
+    if (++s_prof_n >= SENSOR_WINDOW_SCANS) {
+        s_prof.cycles   = s_prof_acc;
+        s_prof.max_scan = s_prof_max;
+        s_prof.scans    = s_prof_n;
+        s_prof_acc = 0; s_prof_max = 0; s_prof_n = 0;
+    }
+}
+
+void Sensor_KernelCycles(sensor_prof_t* p)
+{
+    if (p == NULL) return;
+    uint8 is = CyEnterCriticalSection();
+    *p = s_prof;
+    CyExitCriticalSection(is);
+}
+#endif
+
+#if SENSOR_DECIM_ACQ && (ADC_SAMPLE_MODE != ADC_SAMPLE_MODE_HW_TRIGGERED)
+
+// Set by every Timer_TS terminal count, cleared when a scan is taken for it
+static volatile uint8_t s_ts_armed = 0;
+
+CY_ISR(Sensor_TimerTick)
+{
+#if (ADC_SAMPLE_MODE == ADC_SAMPLE_MODE_SW_TRIGGERED)
+    ADC_StartConvert();   // one scan per tick
+#endif
+    s_ts_armed = 1u;
+    (void)Timer_TS_ReadStatusRegister();   // Clear the interrupt flag
+}
+
+#endif
+
+#if (SENSOR_ACQ_MODE == SENSOR_ACQ_DMA)
+
+// SRAM ring the FinalBuf DMA channel writes whole scans into (one TD per slot)
+static int16 s_ring[SENSOR_RING_SCANS][SENSOR_NUM_CH];
+static uint8 s_ring_td[SENSOR_RING_SCANS];
+static uint8 s_ring_rd = 0;
+static uint8 s_ring_ok = 0;   // 0: no TDs for the ring, the DMA still fills ADC_finalArray
+
+// Last published value, read by the control loop
+static volatile uint16_t s_pp[SENSOR_NUM_CH];
+static volatile uint32_t s_win_seq = 0;
+
+#if (SENSOR_ESTIMATOR == SENSOR_EST_LOCKIN)
+
+// sin(2*pi*k/64) in Q10
+static const int16 s_sin_q10[64] = {
+        0,   100,   200,   297,   391,   482,   568,   649,
+      723,   791,   851,   902,   945,   979,  1003,  1018,
+     1023,  1018,  1003,   979,   945,   902,   851,   791,
+      723,   649,   568,   482,   391,   297,   200,   100,
+        0,  -100,  -200,  -297,  -391,  -482,  -568,  -649,
+     -723,  -791,  -851,  -902,  -945,  -979, -1003, -1018,
+    -1023, -1018, -1003,  -979,  -945,  -902,  -851,  -791,
+     -723,  -649,  -568,  -482,  -391,  -297,  -200,  -100,
+};
+
+// Reference phase advance per scan, 2^32 = one flicker period
+#define LOCKIN_PHASE_STEP  ((uint32_t)((((uint64_t)SENSOR_FLICKER_HZ) << 32) / SENSOR_SAMPLE_HZ))
+
+// Samples are taken relative to the previous window's mean, so
+// |x| <= 4095, |ref| <= 1023 and N <= 256 keep I/Q inside int32.
+static int32_t  s_acc_i[SENSOR_NUM_CH];
+static int32_t  s_acc_q[SENSOR_NUM_CH];
+static int32_t  s_acc_x[SENSOR_NUM_CH];
+static int16    s_dc[SENSOR_NUM_CH];
+static int32_t  s_ref_sin = 0, s_ref_cos = 0;   // sum of the reference itself (for DC removal)
+static uint32_t s_phase = 0;
+static uint16_t s_win_n = 0;
+
+// Lamp flicker is rectified mains, not a sine, so p-p / 2A is not 1. The
+// ratio is measured on the same windows (raw min/max alongside I/Q) and the
+// magnitude is scaled by its slow average, so the p-p band edges keep their
+// meaning while each window still gets the lock-in's noise rejection.
+static int16    s_lk_min[SENSOR_NUM_CH], s_lk_max[SENSOR_NUM_CH];
+static uint16_t s_lk_ratio_q8[SENSOR_NUM_CH] = { 256u, 256u, 256u, 256u, 256u, 256u };
+
+static uint32_t isqrt64(uint64_t v)
+{
+    uint64_t r = 0, bit = (uint64_t)1 << 62;
+    while (bit > v) bit >>= 2;
+    while (bit) {
+        if (v >= r + bit) { v -= r + bit; r = (r >> 1) + bit; }
+        else              { r >>= 1; }
+        bit >>= 2;
+    }
+    return (uint32_t)r;
+}
+
+static void window_reset(void)
+{
+    for (uint8_t ch = 0; ch < SENSOR_NUM_CH; ch++) {
+        s_acc_i[ch] = 0; s_acc_q[ch] = 0; s_acc_x[ch] = 0;
+        s_lk_min[ch] = 4095; s_lk_max[ch] = 0;
+    }
+    s_ref_sin = 0; s_ref_cos = 0;
+    s_win_n = 0;
+}
+
+static void scan_push(const int16* scan)
+{
+    uint8_t k = (uint8_t)(s_phase >> 26);
+    int16 rs = s_sin_q10[k];
+    int16 rc = s_sin_q10[(k + 16u) & 63u];
+    s_phase += LOCKIN_PHASE_STEP;
+    s_ref_sin += rs;
+    s_ref_cos += rc;
+
+    // ADC_finalArray order is reversed: slot [5 - ch] holds channel ch
+    for (uint8_t ch = 0; ch < SENSOR_NUM_CH; ch++) {
+        int16 raw = scan[SENSOR_NUM_CH - 1u - ch];
+        if (raw < s_lk_min[ch]) s_lk_min[ch] = raw;
+        if (raw > s_lk_max[ch]) s_lk_max[ch] = raw;
+        int32_t x = (int32_t)raw - s_dc[ch];
+        s_acc_i[ch] += x * rs;
+        s_acc_q[ch] += x * rc;
+        s_acc_x[ch] += x;
+    }
+
+    if (++s_win_n >= SENSOR_LOCKIN_SCANS) {
+        const int32_t n = (int32_t)s_win_n;
+        for (uint8_t ch = 0; ch < SENSOR_NUM_CH; ch++) {
+            // take out what is left of the DC level (window is not a whole number of periods)
+            int64_t i = (int64_t)s_acc_i[ch] - ((int64_t)s_acc_x[ch] * s_ref_sin) / n;
+            int64_t q = (int64_t)s_acc_q[ch] - ((int64_t)s_acc_x[ch] * s_ref_cos) / n;
+            uint32_t mag = isqrt64((uint64_t)(i * i) + (uint64_t)(q * q));
+
+            // I/Q magnitude = N * A * 1023 / 2, so 2A of the fundamental is
+            uint32_t a2 = (uint32_t)(((uint64_t)mag * 4u) / ((uint32_t)n * 1023u));
+
+            // learn p-p / 2A only from windows well above the noise
+            if (a2 >= SENSOR_LOCKIN_RATIO_MIN) {
+                uint32_t r = ((uint32_t)(s_lk_max[ch] - s_lk_min[ch]) * 256u) / a2;
+                if (r < SENSOR_LOCKIN_RATIO_LO_Q8) r = SENSOR_LOCKIN_RATIO_LO_Q8;
+                if (r > SENSOR_LOCKIN_RATIO_HI_Q8) r = SENSOR_LOCKIN_RATIO_HI_Q8;
+                s_lk_ratio_q8[ch] = (uint16_t)(s_lk_ratio_q8[ch] + ((int32_t)r - s_lk_ratio_q8[ch]) / 16);
+            }
+            uint32_t pp = (a2 * s_lk_ratio_q8[ch]) >> 8;
+            s_pp[ch] = (pp > 0xFFFFu) ? 0xFFFFu : (uint16_t)pp;
+            edge_check(ch, s_pp[ch]);
+
+            s_dc[ch] = (int16)(s_dc[ch] + s_acc_x[ch] / n);
+        }
+        s_win_seq++;
+        window_reset();
+    }
+}
+
+#elif SENSOR_PP_SLIDING
+
+// Monotonic deque: values stay sorted from the front, so the front is the
+// window min (or max). Each sample is pushed and popped at most once.
+typedef struct {
+    int16    val[SENSOR_WINDOW_SCANS];
+    uint16_t idx[SENSOR_WINDOW_SCANS];   // scan number the value came from
+    uint16_t head, count;
+} mono_dq_t;
+
+static mono_dq_t s_dq_min[SENSOR_NUM_CH];
+static mono_dq_t s_dq_max[SENSOR_NUM_CH];
+static uint16_t  s_scan_idx = 0;
+
+static inline uint16_t dq_slot(const mono_dq_t* dq, uint16_t k)
+{
+    uint16_t i = (uint16_t)(dq->head + k);
+    return (i >= SENSOR_WINDOW_SCANS) ? (uint16_t)(i - SENSOR_WINDOW_SCANS) : i;
+}
+
+// is_max = 1 keeps a decreasing deque (front = max), 0 an increasing one (front = min)
+static inline int16 dq_push(mono_dq_t* dq, int16 v, uint16_t n, uint8_t is_max)
+{
+    // drop the front once it has slid out of the window
+    if (dq->count && (uint16_t)(n - dq->idx[dq->head]) >= SENSOR_WINDOW_SCANS) {
+        dq->head = dq_slot(dq, 1u);
+        dq->count--;
+    }
+
+    // drop everything at the back that can never be the extreme again
+    while (dq->count) {
+        int16 back = dq->val[dq_slot(dq, dq->count - 1u)];
+        if (is_max ? (back > v) : (back < v)) break;
+        dq->count--;
+    }
+    uint16_t tail = dq_slot(dq, dq->count);
+    dq->val[tail] = v;
+    dq->idx[tail] = n;
+    dq->count++;
+    return dq->val[dq->head];
+}
+
+static void window_reset(void)
+{
+    for (uint8_t ch = 0; ch < SENSOR_NUM_CH; ch++) {
+        s_dq_min[ch].head = 0; s_dq_min[ch].count = 0;
+        s_dq_max[ch].head = 0; s_dq_max[ch].count = 0;
+    }
+    s_scan_idx = 0;
+}
+
+static void scan_push(const int16* scan)
+{
+    // ADC_finalArray order is reversed: slot [5 - ch] holds channel ch
+    for (uint8_t ch = 0; ch < SENSOR_NUM_CH; ch++) {
+        int16 sample = scan[SENSOR_NUM_CH - 1u - ch];
+        int16 lo = dq_push(&s_dq_min[ch], sample, s_scan_idx, 0u);
+        int16 hi = dq_push(&s_dq_max[ch], sample, s_scan_idx, 1u);
+        s_pp[ch] = (uint16_t)(hi - lo);
+        edge_check(ch, s_pp[ch]);
+    }
+    s_scan_idx++;
+    s_win_seq++;
+}
+
+#else
+
+// Running window, only touched by the ISR
+static int16    s_min[SENSOR_NUM_CH];
+static int16    s_max[SENSOR_NUM_CH];
+static uint16_t s_win_n = 0;
+
+static void window_reset(void)
+{
+    for (uint8_t ch = 0; ch < SENSOR_NUM_CH; ch++) {
+        s_min[ch] = 4095; // start with max possible
+        s_max[ch] = 0;    // start with min possible
+    }
+    s_win_n = 0;
+}
+
+static void scan_push(const int16* scan)
+{
+    // ADC_finalArray order is reversed: slot [5 - ch] holds channel ch
+    for (uint8_t ch = 0; ch < SENSOR_NUM_CH; ch++) {
+        int16 sample = scan[SENSOR_NUM_CH - 1u - ch];
+        if (sample < s_min[ch]) s_min[ch] = sample;
+        if (sample > s_max[ch]) s_max[ch] = sample;
+    }
+
+    if (++s_win_n >= SENSOR_WINDOW_SCANS) {
+        for (uint8_t ch = 0; ch < SENSOR_NUM_CH; ch++) {
+            s_pp[ch] = (uint16_t)(s_max[ch] - s_min[ch]);
+            edge_check(ch, s_pp[ch]);
+        }
+        s_win_seq++;
+        window_reset();
+    }
+}
+
+#endif
+
+// Hand one scan to the estimator (and to a pending capture)
+static void scan_take(const int16* scan)
+{
+#if SENSOR_PROFILE
+    uint32_t t0 = DWT->CYCCNT;
+#endif
+    // ADC_finalArray order is reversed: slot [5 - ch] holds channel ch
+    for (uint8_t ch = 0; ch < SENSOR_NUM_CH; ch++) {
+        int16 v = scan[SENSOR_NUM_CH - 1u - ch];
+        stats_add(ch, v);
+        if (s_cap_armed) capture_sample(ch, v);
+    }
+    if (s_st_n[0] >= SENSOR_WINDOW_SCANS) {
+        for (uint8_t ch = 0; ch < SENSOR_NUM_CH; ch++) stats_publish(ch);
+    }
+    scan_push(scan);
+#if SENSOR_PROFILE
+    prof_scan(DWT->CYCCNT - t0);
+#endif
+}
+
+// Fires when the FinalBuf DMA finishes a TD (= one complete 6 channel scan).
+// The DMA may have moved on by several slots if we were held off, so walk
+// from our read slot up to the TD the channel is working on now.
+CY_ISR(Sensor_ScanDone)
+{
+    if (!s_ring_ok) {
+        // single buffer: only the scan that just landed, and it may be
+        // overwritten while we read it if the ISR was held off
+#if SENSOR_DECIM_ACQ && (ADC_SAMPLE_MODE == ADC_SAMPLE_MODE_FREE_RUNNING)
+        if (!s_ts_armed) return;
+        s_ts_armed = 0u;
+#endif
+        scan_take(ADC_finalArray);
+        return;
+    }
+
+    uint8 cur_td = CY_DMA_INVALID_TD;
+    (void)CyDmaChStatus(ADC_FinalBuf_DmaHandle, &cur_td, NULL);
+
+    uint8_t guard = SENSOR_RING_SCANS;
+    while (s_ring_td[s_ring_rd] != cur_td && guard--) {
+#if SENSOR_DECIM_ACQ && (ADC_SAMPLE_MODE == ADC_SAMPLE_MODE_FREE_RUNNING)
+        // sequencer keeps running, only the first scan after each tick counts
+        if (s_ts_armed) {
+            s_ts_armed = 0u;
+            scan_take(s_ring[s_ring_rd]);
+        }
+#else
+        scan_take(s_ring[s_ring_rd]);
+#endif
+        s_ring_rd = (uint8)((s_ring_rd + 1u) & (SENSOR_RING_SCANS - 1u));
+    }
+}
+
+// Re-point the FinalBuf DMA channel from ADC_finalArray to our ring. The
+// source (the ADC's temp array) is taken from the TD the component set up.
+// If the TD pool runs dry the component's own TD is left in place and the
+// scan ISR reads ADC_finalArray instead.
+static void ring_start(void)
+{
+    uint8  adc_td = CY_DMA_INVALID_TD;
+    uint16 src = 0, dst = 0;
+
+    s_ring_ok = 0;
+    s_ring_rd = 0;
+    window_reset();
+
+    (void)CyDmaChDisable(ADC_FinalBuf_DmaHandle);
+    (void)CyDmaChStatus(ADC_FinalBuf_DmaHandle, &adc_td, NULL);
+    (void)CyDmaTdGetAddress(adc_td, &src, &dst);
+
+    for (uint8_t k = 0; k < SENSOR_RING_SCANS; k++) {
+        s_ring_td[k] = CyDmaTdAllocate();
+        if (s_ring_td[k] == CY_DMA_INVALID_TD) {
+            while (k--) CyDmaTdFree(s_ring_td[k]);
+            (void)CyDmaChEnable(ADC_FinalBuf_DmaHandle, 1u);   // back on adc_td
+            return;
+        }
+    }
+    for (uint8_t k = 0; k < SENSOR_RING_SCANS; k++) {
+        uint8 next = s_ring_td[(k + 1u) & (SENSOR_RING_SCANS - 1u)];
+        (void)CyDmaTdSetConfiguration(s_ring_td[k], (uint16)(SENSOR_NUM_CH * sizeof(int16)), next,
+            ((uint8)ADC_FinalBuf__TD_TERMOUT_EN | (uint8)TD_INC_SRC_ADR | (uint8)TD_INC_DST_ADR));
+        (void)CyDmaTdSetAddress(s_ring_td[k], src, (uint16)(LO16((uint32)s_ring[k])));
+    }
+    s_ring_ok = 1u;
+
+    (void)CyDmaChSetInitialTd(ADC_FinalBuf_DmaHandle, s_ring_td[0]);
+    (void)CyDmaChEnable(ADC_FinalBuf_DmaHandle, 1u);
+}
+
+#endif
+
+void Sensor_Init(void)
+{
+    // free-running core cycle counter for the edge timestamps
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0u;
+    DWT->CTRL  |= DWT_CTRL_CYCCNTENA_Msk;
+
+    ADC_Start();
+#if (SENSOR_ACQ_MODE == SENSOR_ACQ_DMA)
+    ring_start();
+    ADC_IRQ_StartEx(Sensor_ScanDone);
+#endif
+#if SENSOR_DECIM_ACQ
+    Timer_TS_Start();
+#if (ADC_SAMPLE_MODE != ADC_SAMPLE_MODE_HW_TRIGGERED)
+    Timer_TS_SetInterruptMode(Timer_TS_STATUS_TC_INT_MASK);
+    isr_TS_StartEx(Sensor_TimerTick);
+#endif
+#endif
+#if (ADC_SAMPLE_MODE == ADC_SAMPLE_MODE_FREE_RUNNING) && ((SENSOR_ACQ_MODE == SENSOR_ACQ_DMA) || SENSOR_DECIM_ACQ)
+    ADC_StartConvert();   // free running from here on
+#endif
+    CyDelay(10);
+}
+
+void Sensor_GetConfidence(uint8_t channel, sensor_conf_t* c)
+{
+    if (c == NULL) return;
+    if (channel >= SENSOR_NUM_CH) {
+        c->pp = 0; c->samples = 0; c->clipped = 0; c->var = 0;
+        c->conf = 0; c->flags = SENSOR_CONF_FLOATING;
+        return;
+    }
+
+    // p-p from the window var and clipped come from, not the (sliding or
+    // lock-in) value of Sensor_ComputePeakToPeak(), so the figure is one window
+    uint16_t pp = s_cf_pp[channel];
+    c->pp      = pp;
+    c->samples = s_cf_n[channel];
+    c->clipped = s_cf_clip[channel];
+    c->var     = s_cf_var[channel];
+    c->flags   = 0;
+
+    // distance to the nearer band edge, full confidence half a band away
+    uint16_t lo = s_cal_lo[channel], hi = s_cal_hi[channel];
+    uint16_t d_lo = (pp > lo) ? (uint16_t)(pp - lo) : (uint16_t)(lo - pp);
+    uint16_t d_hi = (pp > hi) ? (uint16_t)(pp - hi) : (uint16_t)(hi - pp);
+    uint16_t d    = (d_lo < d_hi) ? d_lo : d_hi;
+    uint16_t half = (uint16_t)((hi - lo) / 2u);
+    c->conf = (d >= half) ? SENSOR_NORM_ONE : (uint16_t)(((uint32_t)d * SENSOR_NORM_ONE) / half);
+
+    if (d < SENSOR_CONF_MARGIN)       c->flags |= SENSOR_CONF_MARGINAL;
+    if (c->clipped)                   c->flags |= SENSOR_CONF_SATURATED;
+    if (pp >= SENSOR_CONF_FLOAT_PP)   c->flags |= SENSOR_CONF_FLOATING;
+    if (c->flags & (SENSOR_CONF_SATURATED | SENSOR_CONF_FLOATING)) c->conf = 0;
+}
+
+uint32_t Sensor_WindowCount(void)
+{
+#if (SENSOR_ACQ_MODE == SENSOR_ACQ_DMA)
+    return s_win_seq;
+#else
+    return 0;
+#endif
+}
+
+#if (SENSOR_ACQ_MODE == SENSOR_ACQ_DMA)
+
+// Peak-peak of the last finished window. Constant time, never touches the ADC
+uint16_t Sensor_ComputePeakToPeak(uint8_t channel) {
+    if (channel >= SENSOR_NUM_CH) return 0;
+    return s_pp[channel];
+}
+
+uint16_t Sensor_ComputePeakToPeakAdaptive(uint8_t channel, uint16_t* samples_used) {
+    if (samples_used) *samples_used = SENSOR_WINDOW_SCANS;
+    return Sensor_ComputePeakToPeak(channel);
+}
+
+uint16_t Sensor_ComputePeakToPeakAll(uint16_t* pp) {
+    for (uint8_t ch = 0; ch < SENSOR_NUM_CH; ch++) {
+        pp[ch] = Sensor_ComputePeakToPeak(ch);
+    }
+    return SENSOR_WINDOW_SCANS;
+}
+
+// The scan ISR keeps the statistics all the time, and there is no batched kernel
+void Sensor_RequestStats(void) { }
+
+#else
+
+#if SENSOR_ADAPTIVE || SENSOR_DECIM_ACQ   // the decimating sampler only lives in the adaptive loop
+uint16_t Sensor_ComputePeakToPeak(uint8_t channel) {
+    return Sensor_ComputePeakToPeakAdaptive(channel, NULL);
+}
+#else
 // Computes the peak-peak value (max - min) of N_SAMPLES from ADC 
 // for the selected channel (eg channel 0 = A0) 
 uint16_t Sensor_ComputePeakToPeak(uint8_t channel) {
@@ -32,4 +692,160 @@ uint16_t max_val = 0; // start with min possible
   // return peak to peak voltage in ADC counts 
  return (max_val - min_val);
 
-}
\ No newline at end of file
+}
+#endif
+
+#if SENSOR_DECIM_ACQ
+// Wait for the next Timer_TS tick, then for the next finished scan, so each
+// read after it is a new conversion. With the free-running ADC that scan may
+// have started up to one scan period before the tick (see sensors.h)
+static void decim_wait(void)
+{
+#if (ADC_SAMPLE_MODE != ADC_SAMPLE_MODE_HW_TRIGGERED)
+    while (!s_ts_armed) { }
+    s_ts_armed = 0u;
+#endif
+    (void)ADC_IsEndConversion(ADC_RETURN_STATUS);   // forget a scan that ended before the tick
+    (void)ADC_IsEndConversion(ADC_WAIT_FOR_RESULT);
+}
+
+static uint16_t decim_sample(uint8_t channel)
+{
+    decim_wait();
+    return (uint16_t)ADC_GetResult16(channel);
+}
+#endif
+
+// Same window as above, but leaves early once the on/off class is settled
+uint16_t Sensor_ComputePeakToPeakAdaptive(uint8_t channel, uint16_t* samples_used) {
+
+    uint16_t min_val = 4095; // start with max possible
+    uint16_t max_val = 0;    // start with min possible
+    uint16_t n = 0;
+
+    if (channel >= SENSOR_NUM_CH) return 0;
+
+    // This channel's band; a channel on the line only leaves it SENSOR_EDGE_HYST
+    // past the upper edge (edge_check), so its class is not final before that
+    const uint16_t exit_lo = s_cal_lo[channel];
+    const uint16_t exit_hi = (uint16_t)(s_cal_hi[channel] +
+                             ((s_line_state & (1u << channel)) ? SENSOR_EDGE_HYST : 0u));
+#if SENSOR_DECIM_ACQ
+    while (n < SENSOR_POLL_SAMPLES) {
+        uint16_t sample = decim_sample(channel);
+#else
+    ADC_StartConvert();
+
+    while (n < SENSOR_POLL_SAMPLES) {
+        uint16_t sample = ADC_GetResult16(channel);
+#endif
+        if (sample < min_val) min_val = sample;
+        if (sample > max_val) max_val = sample;
+        stats_add(channel, (int16_t)sample);
+        n++;
+
+        if (s_cap_armed & (1u << channel)) {
+            capture_sample(channel, (int16_t)sample);
+            continue;   // a capture wants the whole window
+        }
+
+        uint16_t pp = (uint16_t)(max_val - min_val);
+        if (pp >= exit_hi) break;                                   // can only grow: off-line
+        if (n >= SENSOR_ADAPT_MIN_SAMPLES && pp <= exit_lo) break;  // a full period and still flat
+    }
+#if !SENSOR_DECIM_ACQ
+    ADC_StopConvert();
+#endif
+    if (s_cap_armed & (1u << channel)) capture_done(channel);   // window shorter than the buffer
+
+    if (samples_used) *samples_used = n;
+    stats_publish(channel);
+    s_cf_pp[channel] = (uint16_t)(max_val - min_val);
+    edge_check(channel, (uint16_t)(max_val - min_val));
+    return (uint16_t)(max_val - min_val);
+}
+
+// ---- Batched six-channel window ----
+// One window of whole scans serves all six channels, one compare pair per
+// sample. (A packed two-lanes-per-word min/max was tried: the M3 has no SIMD,
+// and the SWAR lane packing and mask selects cost as much as the compares
+// they save, so it was dropped.)
+
+// Statistics for Sensor_GetConfidence() are one more scalar pass over the
+// scan, as much work again as the min/max, so the batched window only runs it
+// when asked (Sensor_RequestStats). A pending capture gets its own pass.
+static volatile uint8_t s_stats_req = 0;
+
+void Sensor_RequestStats(void)
+{
+    s_stats_req = 1u;
+}
+
+// One window of SENSOR_WINDOW_SCANS whole scans, every sample a fresh
+// conversion, instead of six separate windows of one channel each.
+uint16_t Sensor_ComputePeakToPeakAll(uint16_t* pp) {
+    int16 s_lo[SENSOR_NUM_CH], s_hi[SENSOR_NUM_CH];   // ADC_finalArray slot order
+    for (uint8_t j = 0; j < SENSOR_NUM_CH; j++) {
+        s_lo[j] = 4095;        // start with max possible
+        s_hi[j] = 0;           // start with min possible
+    }
+    const uint8_t stats = s_stats_req;
+    s_stats_req = 0u;
+
+#if !SENSOR_DECIM_ACQ
+    ADC_StartConvert();
+#endif
+    for (uint16_t n = 0; n < SENSOR_WINDOW_SCANS; n++) {
+#if SENSOR_DECIM_ACQ
+        decim_wait();
+#else
+        (void)ADC_IsEndConversion(ADC_RETURN_STATUS);
+        (void)ADC_IsEndConversion(ADC_WAIT_FOR_RESULT);
+#endif
+        // ADC_finalArray slot j holds channel 5 - j; raw counts, p-p ignores the SAR shift
+#if SENSOR_PROFILE
+        uint32_t t0 = DWT->CYCCNT;
+#endif
+        for (uint8_t j = 0; j < SENSOR_NUM_CH; j++) {
+            int16 v = ADC_finalArray[j];
+            if (v < s_lo[j]) s_lo[j] = v;
+            if (v > s_hi[j]) s_hi[j] = v;
+        }
+        if (stats) {
+            for (uint8_t ch = 0; ch < SENSOR_NUM_CH; ch++) stats_add(ch, ADC_finalArray[SENSOR_NUM_CH - 1u - ch]);
+        }
+        if (s_cap_armed) {
+            for (uint8_t ch = 0; ch < SENSOR_NUM_CH; ch++) capture_sample(ch, ADC_finalArray[SENSOR_NUM_CH - 1u - ch]);
+        }
+#if SENSOR_PROFILE
+        prof_scan(DWT->CYCCNT - t0);
+#endif
+    }
+#if !SENSOR_DECIM_ACQ
+    ADC_StopConvert();
+#endif
+
+    // min/max per channel (bit 0 of the result = S1)
+    uint16_t w_lo[SENSOR_NUM_CH], w_hi[SENSOR_NUM_CH];
+    for (uint8_t ch = 0; ch < SENSOR_NUM_CH; ch++) {
+        w_lo[ch] = (uint16_t)s_lo[SENSOR_NUM_CH - 1u - ch];
+        w_hi[ch] = (uint16_t)s_hi[SENSOR_NUM_CH - 1u - ch];
+    }
+
+    for (uint8_t ch = 0; ch < SENSOR_NUM_CH; ch++) {
+        pp[ch] = (uint16_t)(w_hi[ch] - w_lo[ch]);
+        if (stats) {
+            stats_publish(ch);
+        } else {
+            // without a statistics pass, "clipped" is whether the window touched a rail
+            s_cf_clip[ch] = (w_lo[ch] == 0u || w_hi[ch] >= 4095u) ? 1u : 0u;
+            s_cf_n[ch]    = SENSOR_WINDOW_SCANS;
+        }
+        s_cf_pp[ch] = pp[ch];
+        if (s_cap_armed & (1u << ch)) capture_done(ch);
+        edge_check(ch, pp[ch]);
+    }
+    return SENSOR_WINDOW_SCANS;
+}
+
+#endif
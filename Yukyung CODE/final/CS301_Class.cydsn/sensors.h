@@ -12,8 +12,226 @@
 // ADC reference voltage (since using Vssa to Vdda, this is boards supply of 5V)
 #define REF_MV 5000 
 
-    
+// On-line band of a peak-to-peak reading (ADC counts), shared with main.c
+#define S_MINC_COUNTS            10
+#define S_MAXC_COUNTS           100
+
+// Adaptive early exit for the polling backend: stop sampling a channel as soon
+// as its class can no longer change. p-p only ever grows within a window, so
+// against the channel's own band (Sensor_SetCalibration, S_MINC/S_MAXC_COUNTS
+// until calibrated)
+//  - p-p >= the upper edge is final at once (off the line; plus
+//    SENSOR_EDGE_HYST while the channel is on it)
+//  - p-p <= the lower edge is trusted after SENSOR_ADAPT_MIN_SAMPLES, i.e. once
+//    the window has seen at least a full flicker period
+// Anything in between is ambiguous and still gets the full window.
+#ifndef SENSOR_ADAPTIVE
+#define SENSOR_ADAPTIVE          1
+#endif
+
+// Acquisition backend (compile time)
+//  SENSOR_ACQ_POLL : Sensor_ComputePeakToPeak() polls SENSOR_POLL_SAMPLES and blocks (original)
+//  SENSOR_ACQ_DMA  : the ADC sequencer streams every scan into an SRAM ring through
+//                    ADC_FinalBuf_dma (ADC_finalArray alone if the ring's TDs cannot be
+//                    allocated), the scan-done ISR keeps min/max per channel and
+//                    Sensor_ComputePeakToPeak() just returns the last finished window
+#define SENSOR_ACQ_POLL      0
+#define SENSOR_ACQ_DMA       1
+#ifndef SENSOR_ACQ_MODE
+#define SENSOR_ACQ_MODE      SENSOR_ACQ_DMA
+#endif
+
+// Channels in the ADC sequencer scan (A0..A5 = S1..S6)
+#define SENSOR_NUM_CH        6
+
+// Scans held in the SRAM ring, one DMA TD per slot (power of two)
+#define SENSOR_RING_SCANS    8u
+
+// Free-running scan rate: ADC_IntClock 1.017 MHz / 18 clocks per 12-bit conversion / 6 channels
+#define SENSOR_SCAN_HZ       9415u
+
+// Decimated acquisition: Timer_TS (100 kHz clock, period 99) ticks at
+// SENSOR_DECIM_HZ and the next scan the free-running SAR finishes after each
+// tick is kept, the rest are dropped. The conversions themselves are not
+// paced: kept samples are 1/SENSOR_DECIM_HZ apart on average with up to one
+// scan period (~106 us) of jitter, and the SAR still runs at SENSOR_SCAN_HZ.
+// Pacing the SAR from Timer_TS needs the ADC sample mode changed in TopDesign
+// (tc to the soc pin, ADC_SAMPLE_MODE_HW_TRIGGERED, or software triggered
+// from isr_TS); the code follows ADC_SAMPLE_MODE if that is ever done, but this
+// project ships free running.
+// 0 takes every free-running scan (SENSOR_SCAN_HZ, timing set by the ADC clock)
+#ifndef SENSOR_DECIM_ACQ
+#define SENSOR_DECIM_ACQ     1
+#endif
+#define SENSOR_DECIM_HZ         1000u
+
+#if SENSOR_DECIM_ACQ
+#define SENSOR_SAMPLE_HZ     SENSOR_DECIM_HZ
+#else
+#define SENSOR_SAMPLE_HZ     SENSOR_SCAN_HZ
+#endif
+
+// Peak-to-peak window (~2 periods of the 100 Hz mains flicker) and its length in scans
+#define SENSOR_WINDOW_MS     20u
+#define SENSOR_WINDOW_SCANS  ((SENSOR_SAMPLE_HZ * SENSOR_WINDOW_MS) / 1000u)
+
+// Amplitude estimator in DMA mode (compile time)
+//  SENSOR_EST_PP     : peak-to-peak of the raw samples (below)
+//  SENSOR_EST_LOCKIN : synchronous detection, each channel is correlated with a
+//                      sin/cos reference at the flicker fundamental over one period.
+//                      The flicker is not a sine, so the fundamental (2A) is scaled
+//                      by a per-channel p-p / 2A ratio measured on the same windows
+//                      and averaged over ~16 of them; only then do the p-p band
+//                      edges (S_MINC/S_MAXC, calibration) apply
+#define SENSOR_EST_PP        0
+#define SENSOR_EST_LOCKIN    1
+#ifndef SENSOR_ESTIMATOR
+#define SENSOR_ESTIMATOR     SENSOR_EST_PP
+#endif
+
+// 50 Hz mains -> lamps flicker at 100 Hz
+#define SENSOR_FLICKER_HZ    100u
+// Lock-in window: one flicker period of scans (max 256, see the overflow note in sensors.c)
+#define SENSOR_LOCKIN_SCANS  ((SENSOR_SAMPLE_HZ + SENSOR_FLICKER_HZ / 2u) / SENSOR_FLICKER_HZ)
+
+// p-p / 2A ratio of the lock-in (Q8, 256 = sine): learnt from windows with 2A of
+// at least SENSOR_LOCKIN_RATIO_MIN counts, kept inside LO..HI
+#define SENSOR_LOCKIN_RATIO_MIN     20u
+#define SENSOR_LOCKIN_RATIO_LO_Q8  128u
+#define SENSOR_LOCKIN_RATIO_HI_Q8 1024u
+
+// Polling backend window. Timed samples are all distinct, so one window of
+// SENSOR_WINDOW_SCANS replaces the 1700 back-to-back reads of N_SAMPLES.
+#if SENSOR_DECIM_ACQ
+#define SENSOR_POLL_SAMPLES      SENSOR_WINDOW_SCANS
+#define SENSOR_ADAPT_MIN_SAMPLES (SENSOR_SAMPLE_HZ / SENSOR_FLICKER_HZ)
+#else
+#define SENSOR_POLL_SAMPLES      N_SAMPLES
+#define SENSOR_ADAPT_MIN_SAMPLES (N_SAMPLES / 4)
+#endif
+
+#if (SENSOR_ESTIMATOR == SENSOR_EST_LOCKIN) && (SENSOR_ACQ_MODE != SENSOR_ACQ_DMA)
+#error "SENSOR_EST_LOCKIN needs the background scans of SENSOR_ACQ_DMA"
+#endif
+
+// Peak-to-peak estimator in DMA mode
+//  0 : tumbling window, one new value every SENSOR_WINDOW_SCANS scans
+//  1 : sliding window over the last SENSOR_WINDOW_SCANS scans, new value every scan
+//      (monotonic min/max deque per channel, amortised O(1) per sample)
+#ifndef SENSOR_PP_SLIDING
+#define SENSOR_PP_SLIDING    1
+#endif
+
+
+// Bring up the ADC (and the background engine in DMA mode). Call once instead of ADC_Start()
+void Sensor_Init(void);
+
 // Function prototype for peak-peak calculation 
 uint16_t Sensor_ComputePeakToPeak(uint8_t channel);
 
+// Same value as Sensor_ComputePeakToPeak(), plus how many samples it took
+// (samples_used may be NULL)
+uint16_t Sensor_ComputePeakToPeakAdaptive(uint8_t channel, uint16_t* samples_used);
+
+// All six channels from one window (pp[SENSOR_NUM_CH], S1..S6), returns the
+// samples per channel. Polling mode reads whole scans and updates the min/max
+// of all six channels from each.
+uint16_t Sensor_ComputePeakToPeakAll(uint16_t* pp);
+
+// How far a reading can be trusted. Statistics come from the last full window
+// (DMA: tumbling SENSOR_WINDOW_SCANS, polling: the channel's last window; the
+// legacy non-adaptive poll loop does not update them).
+typedef struct {
+    uint16_t pp;          // raw p-p of that window (DMA: not the sliding / lock-in value)
+    uint16_t samples;     // samples behind the statistics
+    uint16_t clipped;     // of those, samples on the 0 / 4095 rail
+    uint32_t var;         // window variance, counts^2
+    uint16_t conf;        // 0 .. SENSOR_NORM_ONE, distance from the nearer band edge
+    uint8_t  flags;       // SENSOR_CONF_*
+} sensor_conf_t;
+
+#define SENSOR_CONF_SATURATED    0x01u  // input hit a rail, the p-p is only a lower bound
+#define SENSOR_CONF_FLOATING     0x02u  // p-p far beyond any lit or unlit level: open input
+#define SENSOR_CONF_MARGINAL     0x04u  // within SENSOR_CONF_MARGIN of a band edge
+#define SENSOR_CONF_FLOAT_PP     1000u
+#define SENSOR_CONF_MARGIN          8u
+
+void Sensor_GetConfidence(uint8_t channel, sensor_conf_t* c);
+
+// Batched polling read (Sensor_ComputePeakToPeakAll) only: var and the exact
+// clipped count need a scalar pass over every scan, so they are collected for
+// the next window after this call only. Other windows report clipped as 0/1
+// (did the window touch a rail) and keep var from the last requested window.
+void Sensor_RequestStats(void);
+
+// Estimator cost on the target, in DWT cycles with the ADC waits excluded:
+// the per-scan work of the path that is compiled in (DMA: the scan ISR's
+// estimator, statistics and capture; batched polling: the min/max step plus
+// any statistics / capture pass), summed over the last SENSOR_WINDOW_SCANS
+// scans. Sent over USB with 'p' (usblog.h).
+#ifndef SENSOR_PROFILE
+#define SENSOR_PROFILE           0
+#endif
+typedef struct {
+    uint32_t cycles;      // last full window
+    uint32_t max_scan;    // most expensive single scan in it
+    uint16_t scans;
+} sensor_prof_t;
+void Sensor_KernelCycles(sensor_prof_t* p);
+
+// Number of snapshots published so far (DMA mode), lets the caller see a fresh value
+uint32_t Sensor_WindowCount(void);
+
+// Per-channel on-line band, S_MINC_COUNTS..S_MAXC_COUNTS until calibrated.
+// on_pp / off_pp are the p-p levels measured over the line and over the floor.
+// The pair is only taken if on_pp lies inside the default band and off_pp is at
+// least SENSOR_CAL_FLOOR_RATIO x on_pp and SENSOR_CAL_MIN_SPAN above it, i.e. the
+// sensor really crossed the tape; otherwise the channel gets the default band
+// back and 0 is returned.
+#define SENSOR_CAL_MIN_SPAN      20u
+#define SENSOR_CAL_FLOOR_RATIO    2u
+uint8_t Sensor_SetCalibration(uint8_t channel, uint16_t on_pp, uint16_t off_pp);
+
+// 1 if pp is inside the channel's on-line band
+uint8_t Sensor_IsOnLine(uint8_t channel, uint16_t pp);
+
+// pp mapped across the channel's band: 0 at the low edge .. SENSOR_NORM_ONE at the high edge
+#define SENSOR_NORM_ONE          1024u
+uint16_t Sensor_Normalize(uint8_t channel, uint16_t pp);
+
+// On/off-line transition of one channel, stamped where it was detected:
+// in the scan ISR (DMA mode) or at the end of the channel's window (polling).
+// The robot's position at the edge is dist_mm plus the QuadDec counts the
+// 5 ms task had not folded in yet.
+typedef struct {
+    uint32_t cycles;      // DWT->CYCCNT (BCLK cycles)
+    int32_t  dist_mm;     // g_dist_mm
+    int16_t  qd_m1;       // QuadDec_M1 counter (right wheel)
+    int16_t  qd_m2;       // QuadDec_M2 counter (left wheel)
+    uint8_t  channel;     // 0..5 = S1..S6
+    uint8_t  on_line;     // 1 = entered the band, 0 = left it
+} sensor_edge_t;
+
+#define SENSOR_EDGE_QLEN         16u    // power of two
+#define SENSOR_EDGE_HYST          8u    // counts past the upper edge before leaving the line
+
+// Oldest queued edge; returns 0 if there is none
+uint8_t Sensor_PopEdge(sensor_edge_t* ev);
+
+// Current debounced class of every channel, bit 0 = S1
+uint8_t Sensor_LineState(void);
+
+// Raw capture for offline analysis. Sensor_CaptureArm() freezes the next
+// SENSOR_CAP_SCANS samples of every channel (DMA mode: the scans the
+// estimator sees; polling: each channel's next window, early exit off) into SRAM.
+// The buffer is scan-major [SENSOR_CAP_SCANS][SENSOR_NUM_CH], channel order
+// S1..S6, raw 12-bit counts; n_scans is 0 until the capture is complete.
+// Sensor_CaptureFinish() ends it early (nothing is reading the sensors, or the
+// DMA stopped); n_scans is then the shortest column filled so far.
+#define SENSOR_CAP_SCANS         256u
+void Sensor_CaptureArm(void);
+uint8_t Sensor_CaptureReady(void);
+void Sensor_CaptureFinish(void);
+const int16_t* Sensor_CaptureBuffer(uint16_t* n_scans, uint8_t* chan_mask);
+
 #endif
\ No newline at end of file
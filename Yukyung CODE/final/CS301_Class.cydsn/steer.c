@@ -0,0 +1,254 @@
+#include <stdint.h>
+
+#include "steer.h"
+#include <sensors.h>     // SENSOR_NORM_ONE
+
+/* ===================== Constants ===================== */
+/* pi_step() weighs each channel by 1.5 and calls the row valid above 0.08,
+ * i.e. a raw normalized sum above 0.08 / 1.5 = 0.0533 of SENSOR_NORM_ONE */
+#define STEER_VALID_SUM       ((SENSOR_NORM_ONE * 8u) / 150u)     /* 54 -> sum >= 55 */
+
+/* Integrator decay while the line is lost: 0.92 in Q15 */
+#define STEER_DECAY_Q15       30147
+
+static steer_log_t s_log;
+
+static inline int32_t clamp32(int32_t x, int32_t lo, int32_t hi)
+{
+    return (x < lo) ? lo : ((x > hi) ? hi : x);
+}
+
+/* Q15 -> integer with C truncation (what the float (int) cast does) */
+static inline int q15_trunc(int32_t x)
+{
+    return (int)(x / STEER_Q15_ONE);
+}
+
+/* Q15 -> nearest integer, halves away from zero */
+static inline int q15_round(int32_t x)
+{
+    return (int)((x >= 0) ? ((x + STEER_Q15_ONE / 2) / STEER_Q15_ONE)
+                          : ((x - STEER_Q15_ONE / 2) / STEER_Q15_ONE));
+}
+
+void Steer_Reset(steer_t* s)
+{
+    s->i_q15 = 0;
+    s->u_q15 = 0;
+    s->t_loss_ms = 0;
+}
+
+static inline int32_t lerp32(int32_t a, int32_t b, int32_t num, int32_t den)
+{
+    return a + ((b - a) * num) / den;
+}
+
+void Steer_Schedule(steer_t* s, const steer_gains_t* tab, uint8_t n, int32_t v_mm_s)
+{
+    if (n == 0u) return;
+
+    const steer_gains_t* lo = &tab[0];
+    const steer_gains_t* hi = &tab[0];
+    if (v_mm_s >= tab[n - 1u].v_mm_s) {
+        lo = hi = &tab[n - 1u];
+    } else {
+        for (uint8_t k = 1u; k < n; k++) {
+            if (v_mm_s < tab[k].v_mm_s) {
+                lo = &tab[k - 1u];
+                hi = &tab[k];
+                break;
+            }
+        }
+        if (v_mm_s <= lo->v_mm_s) hi = lo;   /* below the first row */
+    }
+
+    if (hi == lo) {
+        s->kp_q8 = lo->kp_q8;
+        s->ki_q8 = lo->ki_q8;
+        s->u_max = lo->u_max;
+        return;
+    }
+    int32_t num = v_mm_s - lo->v_mm_s;
+    int32_t den = hi->v_mm_s - lo->v_mm_s;
+    s->kp_q8 = lerp32(lo->kp_q8, hi->kp_q8, num, den);
+    s->ki_q8 = lerp32(lo->ki_q8, hi->ki_q8, num, den);
+    /* round the clamp so it moves up at the midpoint, not at the next row */
+    s->u_max = lo->u_max + ((hi->u_max - lo->u_max) * num + den / 2) / den;
+}
+
+uint8_t Steer_PositionQ15(uint16_t n4, uint16_t n5, uint16_t n6, int32_t* pos_q15)
+{
+    int32_t sum = (int32_t)n4 + n5 + n6;
+    if (sum <= (int32_t)STEER_VALID_SUM) {
+        *pos_q15 = 0;
+        return 0u;
+    }
+    /* (-1 * c4 + 0 * c5 + 1 * c6) / sum, |n6 - n4| <= 1024 so << 15 fits */
+    *pos_q15 = (((int32_t)n6 - (int32_t)n4) * STEER_Q15_ONE) / sum;
+    return 1u;
+}
+
+void Steer_LogReset(void)
+{
+    s_log.n = 0u;
+    s_log.lost = 0u;
+    s_log.sum_abs = 0u;
+    s_log.max_abs = 0u;
+}
+
+const steer_log_t* Steer_Log(void)
+{
+    return &s_log;
+}
+
+static void steer_log(uint8_t valid, int32_t e_q15)
+{
+    if (!valid) {
+        s_log.lost++;
+        return;
+    }
+    uint32_t a = (uint32_t)((e_q15 >= 0) ? e_q15 : -e_q15);
+    s_log.n++;
+    s_log.sum_abs += a;
+    if (a > s_log.max_abs) s_log.max_abs = (uint16_t)((a > 0xFFFFu) ? 0xFFFFu : a);
+}
+
+int Steer_PI(steer_t* s, uint8_t valid, int32_t e_q15)
+{
+    const int32_t u_max_q15 = s->u_max * STEER_Q15_ONE;
+
+    steer_log(valid, e_q15);
+    if (!valid) {
+        s->t_loss_ms += s->dt_ms;
+        if (s->t_loss_ms >= s->loss_timeout_ms) {
+            s->t_loss_ms = s->loss_timeout_ms;   /* stop counting, no wrap */
+            s->i_q15 = (int32_t)(((int64_t)s->i_q15 * STEER_DECAY_Q15) >> 15);
+        }
+        return q15_trunc(clamp32(s->u_q15, -u_max_q15, u_max_q15));
+    }
+    s->t_loss_ms = 0;
+
+    /* i += e * dt */
+    int32_t i_next = s->i_q15 + (e_q15 * (int32_t)s->dt_ms + (e_q15 >= 0 ? 500 : -500)) / 1000;
+    i_next = clamp32(i_next, -s->i_lim_q15, s->i_lim_q15);
+
+    /* ki * i reaches STEER_GAIN_MAX_Q8 * i_lim (~1.6e10 at a 30 integrator
+     * limit), so the products are 64-bit and only the clamped sum narrows */
+    int64_t i_term = (int64_t)s->ki_q8 * i_next;
+    int64_t u_raw  = ((int64_t)s->kp_q8 * e_q15 + i_term) / 256;
+    int32_t u = (u_raw >  u_max_q15) ?  u_max_q15 :
+                (u_raw < -u_max_q15) ? -u_max_q15 : (int32_t)u_raw;
+
+    /* don't integrate further into saturation */
+    int64_t i_prev = (int64_t)s->ki_q8 * s->i_q15;
+    uint8_t sat_hi = (u >=  u_max_q15);
+    uint8_t sat_lo = (u <= -u_max_q15);
+    if (!((sat_hi && (i_term > i_prev)) ||
+          (sat_lo && (i_term < i_prev)))) {
+        s->i_q15 = i_next;
+    }
+
+    s->u_q15 = u;
+    return q15_round(u);
+}
+
+int Steer_Step(steer_t* s, uint16_t n4, uint16_t n5, uint16_t n6)
+{
+    int32_t pos = 0;
+    uint8_t valid = Steer_PositionQ15(n4, n5, n6, &pos);
+    return Steer_PI(s, valid, pos);
+}
+
+/* Line weight of one sensor. Sensor_Normalize() rises from the dark edge of
+ * the on-line band (0) to the floor (SENSOR_NORM_ONE), so the line is where
+ * it is low. At or below the band (0) there is no usable signal at all. */
+static inline int32_t line_weight(uint16_t n)
+{
+    return (n == 0u) ? 0 : (int32_t)SENSOR_NORM_ONE - (int32_t)n;
+}
+
+void Steer_EstimateLine(uint16_t n3, uint16_t n4, uint16_t n5, uint16_t n6, steer_line_t* ln)
+{
+    const int32_t p_q8 = (int32_t)STEER_ROW_PITCH_MM * 256;
+    const int32_t x_max_q8 = (int32_t)STEER_X_MAX_MM * 256;
+    int32_t a = line_weight(n4), b = line_weight(n5), c = line_weight(n6);
+    int32_t sum = a + b + c;
+
+    ln->x_q8 = 0;
+    ln->heading_mrad = 0;
+    ln->heading_valid = 0u;
+    ln->front_w = 0u;
+    ln->valid = (sum > (int32_t)STEER_VALID_SUM) ? 1u : 0u;
+    if (!ln->valid) return;
+
+    /* parabola through the strongest sensor and its two neighbours (a sensor
+     * past the end of the row reads as floor, weight 0); its vertex is
+     * P * (l - r) / (2 (l - 2m + r)) from that sensor, at most half a pitch */
+    int32_t w[5] = { 0, a, b, c, 0 };
+    uint8_t k = 1u;
+    if (w[2] > w[k]) k = 2u;
+    if (w[3] > w[k]) k = 3u;
+    int32_t l = w[k - 1u], m = w[k], r = w[k + 1u];
+    int32_t den = l - 2 * m + r;
+    int32_t x = ((int32_t)k - 2) * p_q8;
+    if (den < 0) {
+        x += clamp32((p_q8 * (l - r)) / (2 * den), -p_q8 / 2, p_q8 / 2);
+    }
+    ln->x_q8 = clamp32(x, -x_max_q8, x_max_q8);
+
+    /* S3 is on the centreline: if it sees the line, the line crosses x = 0
+     * STEER_ROW_GAP_MM ahead, and the angle follows from the rear offset */
+    int32_t w3 = line_weight(n3);
+    ln->front_w = (uint16_t)w3;
+    if (w3 > 0) {
+        int32_t h = (-ln->x_q8 * 1000) / ((int32_t)STEER_ROW_GAP_MM * 256);
+        ln->heading_mrad = (int16_t)clamp32(h, -32767, 32767);
+        ln->heading_valid = 1u;
+    }
+}
+
+int32_t Steer_LineErrorQ15(const steer_line_t* ln)
+{
+    int32_t x = ln->x_q8;
+    if (ln->heading_valid) {
+        /* weighted by how firmly S3 sees the line, so nothing jumps when it drops out */
+        int32_t dx = ((int32_t)ln->heading_mrad * STEER_LOOKAHEAD_MM * 256) / 1000;
+        x += (dx * (int32_t)ln->front_w) / (int32_t)SENSOR_NORM_ONE;
+    }
+    /* the brightness centroid reads the line under S4 (x = -P) as +0.5 */
+    return (-x * (STEER_Q15_ONE / 2)) / ((int32_t)STEER_ROW_PITCH_MM * 256);
+}
+
+void Steer_HeadingDampingReset(steer_damp_t* hd)
+{
+    hd->rate_f = 0;
+    hd->prev_mrad = 0;
+    hd->prev_valid = 0u;
+}
+
+int Steer_HeadingDamping(steer_damp_t* hd, const steer_line_t* ln, uint16_t dt_ms)
+{
+    if (!ln->heading_valid || dt_ms == 0u) {
+        /* S3 lost it: no new slope, let the old one fade */
+        hd->prev_valid = 0u;
+        hd->rate_f -= hd->rate_f / 4;
+    } else {
+        if (hd->prev_valid) {
+            int32_t rate = ((int32_t)(ln->heading_mrad - hd->prev_mrad) * 1000) / (int32_t)dt_ms;
+            hd->rate_f += (rate - hd->rate_f) / 4;     /* ~4 calls time constant */
+        }
+        hd->prev_mrad = ln->heading_mrad;
+        hd->prev_valid = 1u;
+    }
+
+    /* a line bending towards +x (S6) wants the opposite sign of a line under S4 */
+    int32_t u = -(hd->k_rate_q8 * hd->rate_f) / (256 * 1000);
+    return (int)clamp32(u, -hd->u_lim, hd->u_lim);
+}
+
+int Steer_StepLine(steer_t* s, uint16_t n3, uint16_t n4, uint16_t n5, uint16_t n6)
+{
+    steer_line_t ln;
+    Steer_EstimateLine(n3, n4, n5, n6, &ln);
+    return Steer_PI(s, ln.valid, Steer_LineErrorQ15(&ln));
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include <stdint.h>
+
+/* Fixed-point line-following controller. The PSoC 5LP M3 has no FPU, so this
+ * is pi_step() from main.c in integers:
+ *  - inputs are Sensor_Normalize() values (Q10, 0 .. SENSOR_NORM_ONE)
+ *  - line position / error in Q15 (-1.0 .. +1.0 = -32768 .. +32768)
+ *  - integrator and output in Q15 units, gains in Q8
+ *  - loss timer in ms
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STEER_Q15_ONE          32768
+#define STEER_GAIN_Q8(g)       ((int32_t)((g) * 256.0f + 0.5f))   /* compile-time constants only */
+
+/* Largest kp_q8 / ki_q8 accepted from the autotuner or the EEPROM record
+ * (steer % per unit error, and per unit error x second). The hand-tuned
+ * table tops out at 18 / 2; a relay result above this is a bad experiment. */
+#define STEER_GAIN_MAX_Q8      STEER_GAIN_Q8(64.0f)
+
+/* Sensor geometry (measure on the chassis). S4 / S5 / S6 form the rear row
+ * across the line, S3 sits on the centreline STEER_ROW_GAP_MM ahead of S5.
+ * +x is towards S6. */
+#define STEER_ROW_PITCH_MM     15      /* S4-S5 and S5-S6 spacing */
+#define STEER_ROW_GAP_MM       30      /* S3 ahead of the rear row */
+#define STEER_X_MAX_MM         (STEER_ROW_PITCH_MM + STEER_ROW_PITCH_MM / 2)   /* half a pitch past S4 / S6 */
+
+/* Lateral offset is taken at this distance ahead of the rear row when the
+ * heading is known (0 = rear row only) */
+#define STEER_LOOKAHEAD_MM     10
+
+/* Line estimate from V3..V6 */
+typedef struct {
+    int32_t x_q8;              /* line offset at the rear row, mm * 256, +x = towards S6 */
+    int16_t heading_mrad;      /* line angle vs. the robot axis, small-angle, + = line bends to +x */
+    uint8_t valid;             /* rear row sees the line */
+    uint16_t front_w;          /* S3 line weight, 0 .. SENSOR_NORM_ONE */
+    uint8_t heading_valid;     /* S3 sees it too */
+} steer_line_t;
+
+typedef struct {
+    /* tuning */
+    int32_t  kp_q8;            /* proportional gain */
+    int32_t  ki_q8;            /* integral gain (per second) */
+    int32_t  u_max;            /* output clamp, steer % */
+    int32_t  i_lim_q15;        /* integrator clamp */
+    uint16_t dt_ms;            /* call period */
+    uint16_t loss_timeout_ms;  /* no line for this long -> integrator decays */
+
+    /* state */
+    int32_t  i_q15;
+    int32_t  u_q15;
+    uint16_t t_loss_ms;
+} steer_t;
+
+/* Heading-rate damping: steer against the rate at which the measured line
+ * angle between S3 and the rear row changes, before the rear-row error has
+ * built up. A derivative on a measurement, not a feed-forward of the path. */
+typedef struct {
+    /* tuning */
+    int32_t  k_rate_q8;        /* steer % per rad/s of heading change */
+    int32_t  u_lim;            /* clamp, steer % */
+
+    /* state */
+    int32_t  rate_f;           /* filtered heading rate, mrad/s */
+    int16_t  prev_mrad;
+    uint8_t  prev_valid;
+} steer_damp_t;
+
+/* Every Steer_PI() call since power-up or Steer_LogReset(), so controller
+ * variants can be compared over the same course (USB 's', usblog.h) */
+typedef struct {
+    uint32_t n;                /* calls with the line */
+    uint32_t lost;             /* calls without */
+    uint32_t sum_abs;          /* sum of |error|, Q15 (~20 min at full scale) */
+    uint16_t max_abs;          /* largest |error|, Q15 */
+} steer_log_t;
+
+/* One row of a gain schedule */
+typedef struct {
+    int32_t  v_mm_s;           /* forward speed the row was tuned at */
+    int32_t  kp_q8;
+    int32_t  ki_q8;
+    int32_t  u_max;
+} steer_gains_t;
+
+/* Clear integrator, output and loss timer (after a turn) */
+void Steer_Reset(steer_t* s);
+
+/* Load kp / ki / u_max for forward speed v_mm_s from a table sorted by speed:
+ * linear between rows, the end rows beyond them */
+void Steer_Schedule(steer_t* s, const steer_gains_t* tab, uint8_t n, int32_t v_mm_s);
+
+/* Weighted line position of the rear row, -1 (under S4) .. +1 (under S6).
+ * Returns 0 when the row sees too little to say (the caller holds its output). */
+uint8_t Steer_PositionQ15(uint16_t n4, uint16_t n5, uint16_t n6, int32_t* pos_q15);
+
+/* PI with clamped integrator and conditional integration; returns steer % */
+int Steer_PI(steer_t* s, uint8_t valid, int32_t e_q15);
+
+void Steer_LogReset(void);
+const steer_log_t* Steer_Log(void);
+
+/* Position + PI, the drop-in for pi_step() */
+int Steer_Step(steer_t* s, uint16_t n4, uint16_t n5, uint16_t n6);
+
+/* Continuous line offset from all four steering sensors: quadratic peak fit
+ * around the strongest of S4/S5/S6, heading from S3 against the rear fit.
+ * Inputs as for Steer_PositionQ15(). */
+void Steer_EstimateLine(uint16_t n3, uint16_t n4, uint16_t n5, uint16_t n6, steer_line_t* ln);
+
+/* Offset at STEER_LOOKAHEAD_MM as a Q15 error with the sign and scale of
+ * Steer_PositionQ15() (line under S4 = +0.5) */
+int32_t Steer_LineErrorQ15(const steer_line_t* ln);
+
+/* Damping steer % for one estimate, called every dt_ms */
+int Steer_HeadingDamping(steer_damp_t* hd, const steer_line_t* ln, uint16_t dt_ms);
+void Steer_HeadingDampingReset(steer_damp_t* hd);
+
+/* Estimate + PI */
+int Steer_StepLine(steer_t* s, uint16_t n3, uint16_t n4, uint16_t n5, uint16_t n6);
+
+#ifdef __cplusplus
+}
+#endif
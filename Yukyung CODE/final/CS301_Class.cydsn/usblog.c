@@ -0,0 +1,186 @@
+#include <project.h>
+#include <stdint.h>
+
+#include "defines.h"     // USE_USB, SOP, BUF_SIZE
+#include "usblog.h"
+#include <sensors.h>     // Sensor_Capture*()
+#include "recover.h"     // Recover_Log()
+#include "steer.h"       // Steer_Log()
+#include "calib.h"       // Calib_Log()
+
+#ifdef USE_USB
+
+/* ===================== Tunables ===================== */
+#define USBLOG_TIMEOUT_MS     20u   /* drop the rest of a block if the host stops reading */
+#define USBLOG_CAP_MAX_MS   1000u   /* send a capture that has not filled by then as it is */
+#define CYC_PER_MS          (BCLK__BUS_CLK__HZ / 1000u)
+
+static uint8_t s_cap_pending = 0;
+static uint32_t s_cap_t0 = 0;       /* DWT->CYCCNT when it was armed */
+
+void USBLog_Init(void)
+{
+    USBUART_Start(0u, USBUART_5V_OPERATION);
+}
+
+/* (Re)initialise CDC whenever the host configures us; 1 once enumerated */
+static uint8_t usb_ready(void)
+{
+    if (USBUART_IsConfigurationChanged() != 0u) {
+        if (USBUART_GetConfiguration() != 0u) {
+            (void)USBUART_CDC_Init();
+        }
+    }
+    return (USBUART_GetConfiguration() != 0u) ? 1u : 0u;
+}
+
+static uint8_t wait_cdc_ready(void)
+{
+    for (uint16_t t = 0; t < USBLOG_TIMEOUT_MS * 10u; t++) {
+        if (USBUART_CDCIsReady() != 0u) return 1u;
+        CyDelayUs(100u);
+    }
+    return 0u;
+}
+
+/* Blocking send in BUF_SIZE packets; a full last packet is followed by a
+ * zero-length one so the host sees the end of the transfer */
+void USBLog_Send(const uint8_t* data, uint16_t len)
+{
+    while (len) {
+        uint16_t n = (len < BUF_SIZE) ? len : BUF_SIZE;
+        if (!wait_cdc_ready()) return;
+        USBUART_PutData(data, n);
+        data += n;
+        len  -= n;
+        if (len == 0u && n == BUF_SIZE) {
+            if (!wait_cdc_ready()) return;
+            USBUART_PutData(NULL, 0u);
+        }
+    }
+}
+
+static void send_capture(void)
+{
+    uint16_t n = 0;
+    uint8_t  mask = 0;
+    const int16_t* buf = Sensor_CaptureBuffer(&n, &mask);
+    const uint16_t hz  = SENSOR_SAMPLE_HZ;
+
+    uint8_t hdr[8] = { SOP, 'C', mask, SENSOR_NUM_CH, LO8(n), HI8(n), LO8(hz), HI8(hz) };
+
+    /* Cortex-M3 is little endian, the samples go out as they sit in SRAM */
+    const uint8_t* payload = (const uint8_t*)buf;
+    uint16_t len = (uint16_t)(n * SENSOR_NUM_CH * sizeof(int16_t));
+
+    uint8_t sum = 0;
+    for (uint8_t k = 1; k < sizeof(hdr); k++) sum += hdr[k];
+    for (uint16_t k = 0; k < len; k++) sum += payload[k];
+
+    USBLog_Send(hdr, sizeof(hdr));
+    USBLog_Send(payload, len);
+    USBLog_Send(&sum, 1u);
+}
+
+void USBLog_SendBlock(uint8_t type, const uint8_t* payload, uint8_t len)
+{
+    uint8_t hdr[2] = { SOP, type };
+    uint8_t sum = type;
+    for (uint8_t k = 0; k < len; k++) sum += payload[k];
+
+    USBLog_Send(hdr, sizeof(hdr));
+    USBLog_Send(payload, len);
+    USBLog_Send(&sum, 1u);
+}
+
+static void send_steer_log(void)
+{
+    const steer_log_t* lg = Steer_Log();
+    uint16_t mean = (uint16_t)((lg->n > 0u) ? lg->sum_abs / lg->n : 0u);
+    uint8_t p[12] = { LO8(LO16(lg->n)),    HI8(LO16(lg->n)),    LO8(HI16(lg->n)),    HI8(HI16(lg->n)),
+                      LO8(LO16(lg->lost)), HI8(LO16(lg->lost)), LO8(HI16(lg->lost)), HI8(HI16(lg->lost)),
+                      LO8(mean), HI8(mean),
+                      LO8(lg->max_abs), HI8(lg->max_abs) };
+    USBLog_SendBlock('S', p, sizeof(p));
+}
+
+#if SENSOR_PROFILE
+static void send_sensor_profile(void)
+{
+    sensor_prof_t pf;
+    Sensor_KernelCycles(&pf);
+    uint8_t p[10] = { LO8(LO16(pf.cycles)),   HI8(LO16(pf.cycles)),   LO8(HI16(pf.cycles)),   HI8(HI16(pf.cycles)),
+                      LO8(LO16(pf.max_scan)), HI8(LO16(pf.max_scan)), LO8(HI16(pf.max_scan)), HI8(HI16(pf.max_scan)),
+                      LO8(pf.scans), HI8(pf.scans) };
+    USBLog_SendBlock('P', p, sizeof(p));
+}
+#endif
+
+static void send_recovery_log(void)
+{
+    const recover_log_t* lg = Recover_Log();
+    uint8_t p[12] = { LO8(lg->count),   HI8(lg->count),
+                      LO8(lg->failed),  HI8(lg->failed),
+                      LO8(lg->last_ms), HI8(lg->last_ms),
+                      LO8(lg->max_ms),  HI8(lg->max_ms),
+                      LO8(LO16(lg->total_ms)), HI8(LO16(lg->total_ms)),
+                      LO8(HI16(lg->total_ms)), HI8(HI16(lg->total_ms)) };
+    USBLog_SendBlock('R', p, sizeof(p));
+}
+
+static void send_calib_log(void)
+{
+    const calib_log_t* lg = Calib_Log();
+    uint8_t p[1 + 4 * SENSOR_NUM_CH];
+    p[0] = lg->mask;
+    for (uint8_t ch = 0; ch < SENSOR_NUM_CH; ch++) {
+        p[1 + 4 * ch] = LO8(lg->on_pp[ch]);  p[2 + 4 * ch] = HI8(lg->on_pp[ch]);
+        p[3 + 4 * ch] = LO8(lg->off_pp[ch]); p[4 + 4 * ch] = HI8(lg->off_pp[ch]);
+    }
+    USBLog_SendBlock('K', p, sizeof(p));
+}
+
+void USBLog_Poll(void)
+{
+    if (!usb_ready()) return;
+
+    if (USBUART_DataIsReady() != 0u) {
+        uint8_t rx[BUF_SIZE];
+        uint16_t n = USBUART_GetAll(rx);
+        for (uint16_t k = 0; k < n; k++) {
+            if (rx[k] == 'c') {
+                Sensor_CaptureArm();
+                s_cap_pending = 1u;
+                s_cap_t0 = DWT->CYCCNT;
+            } else if (rx[k] == 'r') {
+                send_recovery_log();
+            } else if (rx[k] == 's') {
+                send_steer_log();
+            } else if (rx[k] == 'k') {
+                send_calib_log();
+#if SENSOR_PROFILE
+            } else if (rx[k] == 'p') {
+                send_sensor_profile();
+#endif
+            }
+        }
+    }
+
+    if (s_cap_pending && !Sensor_CaptureReady() &&
+        (DWT->CYCCNT - s_cap_t0) / CYC_PER_MS >= USBLOG_CAP_MAX_MS) {
+        Sensor_CaptureFinish();     /* a short (or empty) block beats waiting forever */
+    }
+    if (s_cap_pending && Sensor_CaptureReady()) {
+        s_cap_pending = 0u;
+        send_capture();
+    }
+}
+
+#else
+
+void USBLog_Init(void) { }
+void USBLog_Poll(void) { }
+void USBLog_Send(const uint8_t* data, uint16_t len) { (void)data; (void)len; }
+void USBLog_SendBlock(uint8_t type, const uint8_t* payload, uint8_t len) { (void)type; (void)payload; (void)len; }
+
+#endif
@@ -0,0 +1,39 @@
+#pragma once
+#include <stdint.h>
+
+/* USBUART (CDC) link for bench tools. Compiled to empty stubs without USE_USB (defines.h).
+ * - USBLog_Init(): start the component, call once
+ * - USBLog_Poll(): call every loop; sets up CDC after enumeration, runs host
+ *   commands and ships finished captures
+ *
+ * Host commands (one byte):  'c' = arm a line-sensor capture (Sensor_CaptureArm),
+ *                                  sent when full or after USBLOG_CAP_MAX_MS
+ *                            'r' = send the line-loss recovery log
+ *                            's' = send the steering tracking log
+ *                            'k' = send the startup calibration result
+ *                            'p' = send the estimator profile (SENSOR_PROFILE 1)
+ *
+ * Capture block, little endian:
+ *   SOP 0xaa, 'C', chan_mask, n_ch, n_scans (u16), sample_hz (u16),
+ *   n_scans * n_ch int16 samples (scan-major, S1..S6),
+ *   sum8 of every byte after SOP
+ *
+ * Short blocks (USBLog_SendBlock): SOP, type, payload, sum8 of type + payload
+ *   'R' recovery log:  count, failed, last_ms, max_ms (u16 each), total_ms (u32)
+ *   'S' steering log:  n, lost (u32 each), mean |e|, max |e| (u16 each, Q15)
+ *   'K' calibration:   trusted mask (u8), then on_pp, off_pp (u16 each) for S1..S6
+ *   'P' profile:       cycles, max_scan (u32 each), scans (u16), see Sensor_KernelCycles()
+ *   'T' autotune:      kp_q8, ki_q8, ku_q8 (i32 each), tu_ms, amp_q15 (u16), saved (u8)
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void USBLog_Init(void);
+void USBLog_Poll(void);
+void USBLog_Send(const uint8_t* data, uint16_t len);
+void USBLog_SendBlock(uint8_t type, const uint8_t* payload, uint8_t len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,117 @@
+#include <project.h>
+#include <stdint.h>
+
+#include "wheel.h"
+#include "motor_s.h"     // Motors_SetPercent, clamp100
+
+/* ===================== State ===================== */
+static int32_t s_mm_per_count_x1000 = 1;
+static int32_t s_sample_ms = 5;
+static int32_t s_vmax_mm_s = 1000;
+static int32_t s_dt_ms = 8;
+
+/* last WHEEL_WIN sample counts per wheel, written by the encoder ISR */
+static int16_t s_win[2][WHEEL_WIN];
+static int32_t s_win_sum[2];
+static uint8_t s_win_pos = 0, s_win_fill = 0;
+static volatile int32_t s_speed[2];
+static volatile uint32_t s_abs_ticks = 0;
+
+static int32_t s_i_q8[2];       /* integrator, duty % * 256 */
+static uint16_t s_bad[2];       /* calls in a row asked forward, read <= 0 */
+static uint8_t s_open_loop = 0;
+
+void Wheel_Init(int32_t mm_per_count_x1000, uint16_t sample_ms, int32_t vmax_mm_s, uint16_t dt_ms)
+{
+    s_mm_per_count_x1000 = mm_per_count_x1000;
+    s_sample_ms = (sample_ms > 0u) ? sample_ms : 1;
+    s_vmax_mm_s = (vmax_mm_s > 0) ? vmax_mm_s : 1;
+    s_dt_ms = dt_ms;
+    s_open_loop = 0u;
+    Wheel_Reset();
+}
+
+void Wheel_Reset(void)
+{
+    uint8 irq = CyEnterCriticalSection();
+    for (uint8_t w = 0; w < 2u; w++) {
+        for (uint8_t k = 0; k < WHEEL_WIN; k++) s_win[w][k] = 0;
+        s_win_sum[w] = 0;
+        s_speed[w] = 0;
+        s_i_q8[w] = 0;
+        s_bad[w] = 0;
+    }
+    s_win_pos = 0;
+    s_win_fill = 0;
+    CyExitCriticalSection(irq);
+}
+
+void Wheel_OnCounts(int32_t d_m1, int32_t d_m2)
+{
+    int32_t d[2] = { d_m1 * WHEEL_QD_SIGN_R, d_m2 * WHEEL_QD_SIGN_L };
+
+    s_abs_ticks += (uint32_t)((d_m1 >= 0) ? d_m1 : -d_m1) + (uint32_t)((d_m2 >= 0) ? d_m2 : -d_m2);
+
+    if (s_win_fill < WHEEL_WIN) s_win_fill++;
+    for (uint8_t w = 0; w < 2u; w++) {
+        s_win_sum[w] += d[w] - s_win[w][s_win_pos];
+        s_win[w][s_win_pos] = (int16_t)d[w];
+        /* counts * mm/count over fill * sample_ms */
+        s_speed[w] = (s_win_sum[w] * s_mm_per_count_x1000) / ((int32_t)s_win_fill * s_sample_ms);
+    }
+    s_win_pos = (uint8_t)((s_win_pos + 1u) & (WHEEL_WIN - 1u));
+}
+
+int32_t Wheel_SpeedMmS(uint8_t wheel)
+{
+    return (wheel < 2u) ? s_speed[wheel] : 0;
+}
+
+uint32_t Wheel_AbsTicks(void)
+{
+    return s_abs_ticks;
+}
+
+uint8_t Wheel_ClosedLoop(void)
+{
+    return s_open_loop ? 0u : 1u;
+}
+
+/* Polarity guard for one wheel, see WHEEL_CHECK_* */
+static void wheel_check(uint8_t w, int32_t v_ref)
+{
+    if (v_ref >= WHEEL_CHECK_MIN_MM_S && s_speed[w] <= 0) {
+        if (++s_bad[w] >= WHEEL_CHECK_CALLS) s_open_loop = 1u;
+    } else {
+        s_bad[w] = 0;
+    }
+}
+
+/* One wheel: open-loop duty plus PI on the speed error, returns duty % */
+static int wheel_pi(uint8_t w, int32_t v_ref)
+{
+    int32_t ff   = (v_ref * 100) / s_vmax_mm_s;
+    wheel_check(w, v_ref);
+    if (s_open_loop) return clamp100((int)ff);
+
+    int32_t e    = v_ref - s_speed[w];
+    int32_t i_nx = s_i_q8[w] + (e * WHEEL_KI_Q8 * s_dt_ms) / 1000;
+    if (i_nx >  WHEEL_I_LIM * 256) i_nx =  WHEEL_I_LIM * 256;
+    if (i_nx < -WHEEL_I_LIM * 256) i_nx = -WHEEL_I_LIM * 256;
+
+    int32_t duty = ff + (e * WHEEL_KP_Q8 + i_nx) / 256;
+
+    /* hold the integrator while the duty is pinned in the same direction */
+    if (!((duty >  100 && i_nx > s_i_q8[w]) ||
+          (duty < -100 && i_nx < s_i_q8[w]))) {
+        s_i_q8[w] = i_nx;
+    }
+    return clamp100((int)duty);
+}
+
+void Wheel_Drive(int32_t v_left_mm_s, int32_t v_right_mm_s)
+{
+    int dl = wheel_pi(WHEEL_LEFT,  v_left_mm_s);
+    int dr = wheel_pi(WHEEL_RIGHT, v_right_mm_s);
+    Motors_SetPercent((int8_t)dl, (int8_t)dr);
+}
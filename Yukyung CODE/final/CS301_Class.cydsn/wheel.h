@@ -0,0 +1,68 @@
+#pragma once
+#include <stdint.h>
+
+/* Per-wheel speed loops. The 5 ms encoder ISR feeds counts in, the main loop
+ * asks for a speed per wheel (mm/s) and gets PI-corrected duties on the
+ * motors, so cruise speed and steering no longer depend on battery level,
+ * floor friction or a hand-set trim. */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Sign of the counts when the wheel rolls forward (M1 = right, M2 = left).
+ * Taken from the odometer (main.c odo_mm / isr_qd), which has always
+ * measured forward travel as |m1| + |m2| signed by m1 + m2, i.e. both
+ * counters count up going forward. The motor PWM signs differ, the
+ * encoders do not. */
+#ifndef WHEEL_QD_SIGN_R
+#define WHEEL_QD_SIGN_R        (+1)
+#endif
+#ifndef WHEEL_QD_SIGN_L
+#define WHEEL_QD_SIGN_L        (+1)
+#endif
+
+/* Speed = counts over the last WHEEL_WIN encoder samples (power of two).
+ * At 228 counts per turn one count in 8 x 5 ms is ~23 mm/s. */
+#define WHEEL_WIN              8u
+
+/* Polarity / encoder guard: a wheel asked for at least WHEEL_CHECK_MIN_MM_S
+ * forward that reads <= 0 mm/s for WHEEL_CHECK_CALLS Wheel_Drive() calls in a
+ * row has a wrong sign or a dead encoder; its PI would be positive feedback,
+ * so Wheel_Drive() drops to the open-loop duty for good (until Wheel_Init) */
+#define WHEEL_CHECK_MIN_MM_S   80
+#define WHEEL_CHECK_CALLS      40      /* ~0.3 s at 8 ms */
+
+/* Inner PI on top of the open-loop duty (v * 100 / vmax), duty % per mm/s in Q8 */
+#define WHEEL_KP_Q8            13      /* 0.05 % per mm/s */
+#define WHEEL_KI_Q8           128      /* 0.5 % per mm/s per second */
+#define WHEEL_I_LIM            40      /* integrator share of the duty, % */
+
+#define WHEEL_RIGHT            0u
+#define WHEEL_LEFT             1u
+
+/* mm_per_count_x1000 / sample_ms describe the encoder ISR, vmax_mm_s is the
+ * speed at 100 % duty, dt_ms the period Wheel_Drive() is called at */
+void Wheel_Init(int32_t mm_per_count_x1000, uint16_t sample_ms, int32_t vmax_mm_s, uint16_t dt_ms);
+
+/* Forget the speed window and integrators (after a pivot or a stop) */
+void Wheel_Reset(void);
+
+/* Raw QuadDec counts since the last call (ISR context) */
+void Wheel_OnCounts(int32_t d_m1, int32_t d_m2);
+
+/* Measured speed, mm/s, + = forward */
+int32_t Wheel_SpeedMmS(uint8_t wheel);
+
+/* |counts| of both wheels summed since power-up, the pivot measure of
+ * directions.c (~90 per 90 degrees), independent of WHEEL_QD_SIGN_* */
+uint32_t Wheel_AbsTicks(void);
+
+/* Track the two wheel speeds (mm/s) and write the motor duties */
+void Wheel_Drive(int32_t v_left_mm_s, int32_t v_right_mm_s);
+
+/* 0 once the guard above has dropped Wheel_Drive() to open loop */
+uint8_t Wheel_ClosedLoop(void);
+
+#ifdef __cplusplus
+}
+#endif